@@ -7,6 +7,10 @@
 #include <iterator>
 #include <functional>
 #include <utility>
+#include <future>
+
+#include "thread_pool.hpp"
+#include "random.hpp"
 
 namespace
 {
@@ -18,14 +22,13 @@ void print_arr ( const Container& container )
     std::cout << std::endl;
 }
 
+/// @brief Заполняет [begin, end) значениями из [0, 14]
+/// @param offset номер первого элемента в массиве: значения зависят только
+/// от seed и номера, а не от того, какой поток их пишет
 template < typename It >
-void fill_w_rand( It&& begin, It&& end )
+void fill_w_rand( It begin, It end, uint64_t seed, uint64_t offset )
 {
-    std::for_each( begin, end,
-    [] ( auto& elem )
-    {
-        elem = std::rand() % 15;
-    } );
+    custom::fill_uniform< int32_t >( std::to_address( begin ), std::distance( begin, end ), 0, 14, seed, offset );
 };
 
 template < typename It >
@@ -43,13 +46,14 @@ void inc_n_check( It&& begin, It&& end )
 
 void fill_w_rand_n_check(
     std::pair<std::vector<int>::iterator, std::vector<int>::iterator> begin,
-    std::pair<std::vector<int>::iterator, std::vector<int>::iterator> end )
+    std::pair<std::vector<int>::iterator, std::vector<int>::iterator> end,
+    uint64_t seed, uint64_t offset )
 {
     inc_n_check( begin.second, end.second );
-    fill_w_rand( begin.first, end.first );
+    fill_w_rand( begin.first, end.first, seed, offset );
 }
 
-std::vector< int32_t> get_values( std::size_t arr_size, int32_t thread_count )
+std::vector< int32_t> get_values( custom::thread_pool& pool, std::size_t arr_size, int32_t thread_count, uint64_t seed )
 {
     if ( thread_count > arr_size || arr_size <=0 || thread_count <= 0 )
     {
@@ -60,9 +64,7 @@ std::vector< int32_t> get_values( std::size_t arr_size, int32_t thread_count )
     auto arr_rand = std::vector< int32_t > ( arr_size, 0 );
     auto arr_counter = std::vector< int32_t > ( arr_size, 0 );
 
-    auto rng = [] { return std::rand() % 5 + 1; };
-
-    auto arr_thread = std::vector< std::thread > ();
+    auto arr_task = std::vector< std::future< void > > ();
     auto check_arr = std::vector< int32_t > ( arr_size, 0 );
 
     int32_t per_count = arr_size / thread_count;
@@ -71,19 +73,17 @@ std::vector< int32_t> get_values( std::size_t arr_size, int32_t thread_count )
     for ( int i = 0; i < thread_count; ++i )
     {
         auto start_distance = std::exchange( latest, latest + per_count );
-        arr_thread.push_back(
-            std::thread{ [&, start_distance, per_count, latest]
+        arr_task.push_back(
+            pool.submit( [&, start_distance, per_count, latest]
         {
-            // std::generate_n( arr_rand.begin() + start_distance,
-            //        per_count, std::ref( rng ) );
             fill_w_rand_n_check(
                 {  arr_rand.begin() + start_distance, arr_counter.begin() + start_distance },
-                { arr_rand.begin() + latest,  arr_counter.begin() + latest } );
+                { arr_rand.begin() + latest,  arr_counter.begin() + latest }, seed, start_distance );
             #ifdef DEBUG
                 print_arr( arr_rand );
                 print_arr( arr_counter );
             #endif
-        } }
+        } )
         );
         #ifdef DEBUG
             std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
@@ -91,8 +91,8 @@ std::vector< int32_t> get_values( std::size_t arr_size, int32_t thread_count )
     }
 
     auto tmp = arr_size - arr_size % thread_count;
-    fill_w_rand_n_check( { arr_rand.begin() + tmp, arr_counter.begin() + tmp, }, {  arr_rand.begin() + tmp + ( arr_size % thread_count ),  arr_counter.begin() + tmp + ( arr_size % thread_count ) } );
-    for ( auto& thread : arr_thread ) { if ( thread.joinable() ) thread.join(); }
+    fill_w_rand_n_check( { arr_rand.begin() + tmp, arr_counter.begin() + tmp, }, {  arr_rand.begin() + tmp + ( arr_size % thread_count ),  arr_counter.begin() + tmp + ( arr_size % thread_count ) }, seed, tmp );
+    for ( auto& task : arr_task ) { task.get(); }
     #ifdef DEBUG
         print_arr( arr_rand );
     #endif
@@ -104,23 +104,29 @@ std::vector< int32_t> get_values( std::size_t arr_size, int32_t thread_count )
 int main( int argc, char ** argv )
 try
 {
-    srand(time(nullptr));
+    auto pool = custom::thread_pool{};
 #ifdef DEBUG
     if ( argc < 3 )
     {
-        std::cerr << "Usage: " << argv[0] << " <array_size> <thread_count>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <array_size> <thread_count> [seed]" << std::endl;
         return EXIT_FAILURE;
     }
     int32_t arr_size = std::stoi( argv[1] );
     int32_t thread_count = std::stoi ( argv[ 2 ]  );
-    auto values = get_values( arr_size, thread_count );
+    uint64_t seed = argc > 3 ? std::stoull( argv[ 3 ] ) : custom::philox4x32::default_seed;
+    auto values = get_values( pool, arr_size, thread_count, seed );
 #else
+    uint64_t seed = argc > 1 ? std::stoull( argv[ 1 ] ) : std::random_device{}();
+    std::cout << "seed: " << seed << std::endl;
+    auto rng = custom::philox4x32{ seed, 1 };
+    auto sizes = std::uniform_int_distribution< int32_t >{ 1, 1000 };
+    auto threads = std::uniform_int_distribution< int32_t >{ 1, 50 };
     while ( true )
     {
-        int32_t arr_size = std::rand() % 1000 + 1;
-        int32_t thread_count = std::rand() % 50 + 1;
+        int32_t arr_size = sizes( rng );
+        int32_t thread_count = threads( rng );
         std::cout << "arr_size: " << arr_size << " | thread_count: " << thread_count << std::endl;
-        auto values = get_values( arr_size, thread_count );
+        auto values = get_values( pool, arr_size, thread_count, seed );
         std::cout << "OK" << std::endl;
         std::this_thread::sleep_for ( std::chrono::seconds ( 3 ) );
     }
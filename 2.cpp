@@ -3,36 +3,18 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <bit>
+#include <new>
+#include <vector>
+#include <chrono>
 
-namespace custom
-{
+#include "thread_pool.hpp"
 
-class thread_joiner
+namespace custom
 {
-public:
-    /// @brief Конструктор
-    /// @param thread захватываемый поток
-    explicit thread_joiner( std::thread&& thread )
-        : thread_( std::move( thread ) )
-    {
-    }
-
-    /// @brief Деструктор
-    /// Вызов join
-    ~thread_joiner()
-    {
-        if (thread_.joinable())
-        {
-            thread_.join();
-        }
-    }
-
-    /// @return Захваченный поток
-    std::thread& get() { return thread_; }
-
-private:
-    std::thread thread_;
-};
 
 template <
     class T,
@@ -133,11 +115,74 @@ public: // modifiers
         return true;
     }
 
+    /// @brief Извлекает элемент из головы в out под одним захватом мьютекса
+    /// @return false, если очередь пуста
+    bool try_pop( T& out )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( queue_.empty() )
+        {
+            return false;
+        }
+        out = std::move( queue_.front() );
+        queue_.pop();
+        return true;
+    }
+
+    /// @brief Ожидает элемент и возвращает его перемещением
+    T wait_and_pop()
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+        cv_.wait( lock, [ this ] { return !queue_.empty(); } );
+        auto value = std::move( queue_.front() );
+        queue_.pop();
+        return value;
+    }
+
+    /// @brief Извлекает не более n элементов за один захват мьютекса
+    /// @param out итератор вывода для извлечённых элементов
+    /// @return Количество извлечённых элементов
+    template < class OutputIt >
+    std::size_t pop_up_to( std::size_t n, OutputIt out )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        auto count = std::min( n, queue_.size() );
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            *out++ = std::move( queue_.front() );
+            queue_.pop();
+        }
+        return count;
+    }
+
+    /// @brief Добавляет диапазон [first, last) за один захват мьютекса
+    /// и одно оповещение ожидающих
+    template < class InputIt >
+    void push_range( InputIt first, InputIt last )
+    {
+        std::size_t pushed = 0;
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            for ( ; first != last; ++first, ++pushed )
+            {
+                queue_.push( *first );
+            }
+        }
+        if ( pushed == 1 )
+        {
+            cv_.notify_one();
+        }
+        else if ( pushed > 1 )
+        {
+            cv_.notify_all();
+        }
+    }
+
     template <class... Args>
     void emplace( Args&&... args )
     {
         std::lock_guard<std::mutex> lock( mutex_ );
-        queue_.emplace( args... );
+        queue_.emplace( std::forward<Args>( args )... );
         cv_.notify_one();
     }
 
@@ -164,15 +209,267 @@ private:
     std::queue<T, Container> queue_;
 };
 
+/// @brief Размер кэш-линии, по которому выравниваются разделяемые счётчики
+inline constexpr std::size_t cache_line_size = 64;
+
+namespace detail
+{
+
+/// @brief Вызывает fn при выходе из области видимости, в том числе по исключению
+template < class F >
+struct scope_exit
+{
+    F fn;
+
+    ~scope_exit() { fn(); }
+};
+
+} // namespace detail
+
+/// @brief Ограниченная lock-free очередь MPMC на кольцевом буфере
+/// Каждая ячейка хранит номер последовательности, по которому производители
+/// и потребители определяют, свободна ли она (схема Д. Вьюкова).
+/// Ёмкость округляется вверх до степени двойки. Занятая ячейка публикуется
+/// и тогда, когда конструктор T бросил исключение: она остаётся пустой,
+/// и потребители её пропускают, так что очередь не встаёт.
+template < class T >
+class mpmc_ring
+{
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        /// В storage лежит объект; пишется до публикации sequence
+        bool engaged = false;
+        alignas( T ) unsigned char storage[ sizeof( T ) ];
+
+        T* value() { return std::launder( reinterpret_cast<T*>( storage ) ); }
+    };
+
+    struct alignas( cache_line_size ) padded_index
+    {
+        std::atomic<std::size_t> value{ 0 };
+    };
+
+public: // special functions
+    /// @brief Конструктор
+    /// @param capacity минимальная ёмкость очереди
+    explicit mpmc_ring( std::size_t capacity )
+        : capacity_( std::bit_ceil( std::max<std::size_t>( capacity, 2 ) ) )
+        , mask_( capacity_ - 1 )
+        , cells_( std::make_unique<cell[]>( capacity_ ) )
+    {
+        for ( std::size_t i = 0; i < capacity_; ++i )
+        {
+            cells_[ i ].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    /// @brief Деструктор
+    /// Разрушает оставшиеся в очереди элементы
+    ~mpmc_ring()
+    {
+        while ( try_pop() )
+        {
+        }
+    }
+
+    mpmc_ring( const mpmc_ring& other ) = delete;
+    mpmc_ring( mpmc_ring&& other ) = delete;
+
+public: // operator=
+    mpmc_ring& operator=( const mpmc_ring& other ) = delete;
+    mpmc_ring& operator=( mpmc_ring&& other ) = delete;
+
+public: // capacity
+    /// @return Приблизительное число элементов (точно только в покое)
+    std::size_t size() const
+    {
+        auto head = head_.value.load( std::memory_order_acquire );
+        auto tail = tail_.value.load( std::memory_order_acquire );
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+public: // modifiers
+    /// @return false, если очередь заполнена
+    template <class... Args>
+    bool try_emplace( Args&&... args )
+    {
+        auto pos = tail_.value.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            auto& slot = cells_[ pos & mask_ ];
+            auto seq = slot.sequence.load( std::memory_order_acquire );
+            auto diff = static_cast<std::intptr_t>( seq ) - static_cast<std::intptr_t>( pos );
+            if ( diff == 0 )
+            {
+                if ( tail_.value.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    slot.engaged = false;
+                    auto publish = detail::scope_exit{ [ & ] { slot.sequence.store( pos + 1, std::memory_order_release ); } };
+                    ::new ( static_cast<void*>( slot.storage ) ) T( std::forward<Args>( args )... );
+                    slot.engaged = true;
+                    return true;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail_.value.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    bool try_push( const T& value )
+    {
+        return try_emplace( value );
+    }
+
+    bool try_push( T&& value )
+    {
+        return try_emplace( std::move( value ) );
+    }
+
+    /// @brief Извлекает элемент в out
+    /// @return false, если очередь пуста
+    bool try_pop( T& out )
+    {
+        return try_consume( [ &out ]( T& value ) { out = std::move( value ); } );
+    }
+
+    /// @brief Удаляет элемент из головы, не возвращая его
+    bool try_pop()
+    {
+        return try_consume( []( T& ) {} );
+    }
+
+    /// @brief Блокирующие варианты: ожидают свободной ячейки или элемента
+    template <class... Args>
+    void emplace( Args&&... args )
+    {
+        for ( std::uint32_t spins = 0; !try_emplace( std::forward<Args>( args )... ); )
+        {
+            backoff( spins );
+        }
+    }
+
+    void push( const T& value )
+    {
+        emplace( value );
+    }
+
+    void push( T&& value )
+    {
+        for ( std::uint32_t spins = 0; !try_emplace( std::move( value ) ); )
+        {
+            backoff( spins );
+        }
+    }
+
+    void wait_n_pop( T& out )
+    {
+        for ( std::uint32_t spins = 0; !try_pop( out ); )
+        {
+            backoff( spins );
+        }
+    }
+
+    void wait_n_pop()
+    {
+        for ( std::uint32_t spins = 0; !try_pop(); )
+        {
+            backoff( spins );
+        }
+    }
+
+private:
+    /// @brief Передаёт элемент головы в consumer и освобождает ячейку
+    /// Если consumer бросил исключение, элемент всё равно разрушается,
+    /// а ячейка освобождается. Пустые ячейки пропускаются.
+    template < class Consumer >
+    bool try_consume( Consumer&& consumer )
+    {
+        auto pos = head_.value.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            auto& slot = cells_[ pos & mask_ ];
+            auto seq = slot.sequence.load( std::memory_order_acquire );
+            auto diff = static_cast<std::intptr_t>( seq ) - static_cast<std::intptr_t>( pos + 1 );
+            if ( diff == 0 )
+            {
+                if ( head_.value.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    const auto engaged = slot.engaged;
+                    {
+                        auto release = detail::scope_exit{ [ & ]
+                        {
+                            if ( engaged )
+                            {
+                                std::destroy_at( slot.value() );
+                            }
+                            slot.sequence.store( pos + capacity_, std::memory_order_release );
+                        } };
+                        if ( engaged )
+                        {
+                            consumer( *slot.value() );
+                            return true;
+                        }
+                    }
+                    pos = head_.value.load( std::memory_order_relaxed );
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = head_.value.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /// @brief Короткое активное ожидание, затем уступка процессора
+    static void backoff( std::uint32_t& spins )
+    {
+        if ( ++spins < 64 )
+        {
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+private:
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+
+private: // sync
+    padded_index head_;
+    padded_index tail_;
+};
+
 } // namespace custom
 
 
 void stdout_queue( custom::tsafe_queue<int32_t> & q )
 {
-    while ( !q.empty() )
+    int32_t value = 0;
+    while ( q.try_pop( value ) )
     {
-        std::cout << q.front() << std::endl;
-        q.try_pop();
+        std::cout << value << std::endl;
     }
 }
 
@@ -205,16 +502,143 @@ void run_test_case()
     });
 
     x.join();
+
+    auto batch = std::vector<int32_t>{ 4, 5, 6 };
+    tsafe_queue.push_range( batch.begin(), batch.end() );
+    std::cout << "tsafe_queue.wait_and_pop() : " << tsafe_queue.wait_and_pop() << std::endl;
+
     std::cout << "stdout queque" << std::endl;
     stdout_queue( tsafe_queue );
     std::cout << "another_tsafe_queue" << std::endl;
 }
 
+#ifdef BENCHMARK
+/// @brief Прогоняет items элементов через очередь producers производителями
+/// и consumers потребителями
+/// @return Время в миллисекундах
+template < class Push, class Pop >
+double measure_fan_in( std::size_t producers, std::size_t consumers, std::size_t items, Push push, Pop pop )
+{
+    auto consumed = std::atomic<std::size_t>{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto threads = std::vector<std::jthread>{};
+        threads.reserve( producers + consumers );
+        for ( std::size_t p = 0; p < producers; ++p )
+        {
+            threads.emplace_back( [ &, p ]
+            {
+                for ( auto i = p; i < items; i += producers )
+                {
+                    push( static_cast<int32_t>( i ) );
+                }
+            } );
+        }
+        for ( std::size_t c = 0; c < consumers; ++c )
+        {
+            threads.emplace_back( [ & ]
+            {
+                while ( consumed.load( std::memory_order_relaxed ) < items )
+                {
+                    if ( std::size_t popped = pop() )
+                    {
+                        consumed.fetch_add( popped, std::memory_order_relaxed );
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            } );
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>( end - start ).count();
+}
+
+/// @brief Задержка submit -> get для одиночной пустой задачи и пропускная
+/// способность на множестве крошечных задач: пул против std::thread на задачу
+void run_pool_benchmark()
+{
+    constexpr std::size_t latency_rounds = 10000;
+    constexpr std::size_t tiny_tasks = 1 << 18;
+    constexpr std::size_t spawned_threads = 1 << 12;
+
+    custom::thread_pool pool;
+    auto start = std::chrono::steady_clock::now();
+    for ( std::size_t i = 0; i < latency_rounds; ++i )
+    {
+        pool.submit( [] {} ).get();
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto latency_us = std::chrono::duration<double, std::micro>( end - start ).count() / latency_rounds;
+
+    auto counter = std::atomic<std::size_t>{ 0 };
+    start = std::chrono::steady_clock::now();
+    pool.parallel_for( std::size_t{ 0 }, tiny_tasks, std::size_t{ 1 }, [ & ]( std::size_t, std::size_t )
+    {
+        counter.fetch_add( 1, std::memory_order_relaxed );
+    } );
+    end = std::chrono::steady_clock::now();
+    auto pool_rate = tiny_tasks / std::chrono::duration<double>( end - start ).count();
+
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t i = 0; i < spawned_threads; ++i )
+    {
+        custom::thread_joiner { std::thread( [ & ] { counter.fetch_add( 1, std::memory_order_relaxed ); } ) };
+    }
+    end = std::chrono::steady_clock::now();
+    auto thread_rate = spawned_threads / std::chrono::duration<double>( end - start ).count();
+
+    std::cout << "pool workers: " << pool.size() << std::endl;
+    std::cout << "submit->get latency: " << latency_us << " us" << std::endl;
+    std::cout << "tiny tasks/s, pool: " << pool_rate << std::endl;
+    std::cout << "tiny tasks/s, thread per task: " << thread_rate << std::endl;
+}
+
+void run_contention_benchmark()
+{
+    constexpr std::size_t items = 1 << 20;
+    constexpr std::size_t batch = 64;
+    std::cout << "threads,tsafe_queue_ms,tsafe_queue_batch_ms,mpmc_ring_ms" << std::endl;
+    for ( std::size_t threads = 1; threads <= 64; threads *= 2 )
+    {
+        auto producers = std::max<std::size_t>( threads / 2, 1 );
+        auto consumers = std::max<std::size_t>( threads - producers, 1 );
+
+        custom::tsafe_queue<int32_t> locked;
+        auto locked_ms = measure_fan_in( producers, consumers, items,
+            [ & ]( int32_t v ) { locked.push( v ); },
+            [ & ] { int32_t v; return locked.try_pop( v ); } );
+
+        custom::tsafe_queue<int32_t> batched;
+        auto batched_ms = measure_fan_in( producers, consumers, items,
+            [ & ]( int32_t v ) { batched.push( v ); },
+            [ & ]
+            {
+                int32_t out[ batch ];
+                return batched.pop_up_to( batch, out );
+            } );
+
+        custom::mpmc_ring<int32_t> ring( 1024 );
+        auto ring_ms = measure_fan_in( producers, consumers, items,
+            [ & ]( int32_t v ) { ring.push( v ); },
+            [ & ] { int32_t v; return ring.try_pop( v ); } );
+
+        std::cout << threads << ',' << locked_ms << ',' << batched_ms << ',' << ring_ms << std::endl;
+    }
+}
+#endif
+
 int32_t main()
 try
 {
     std::queue<int32_t> q;
     run_test_case();
+#ifdef BENCHMARK
+    run_contention_benchmark();
+    run_pool_benchmark();
+#endif
     return EXIT_SUCCESS;
 }
 catch( const std::exception &e )
@@ -4,24 +4,83 @@
 #include <condition_variable>
 #include <cassert>
 #include <functional>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+#ifdef BENCHMARK
+#include <barrier>
+#include <chrono>
+#endif
 
 namespace custom
 {
 
+namespace detail
+{
+
+/// @brief Число холостых проверок перед засыпанием
+/// Ожидание в цикле окупается, только если каждому участнику хватает ядра
+/// @param thread_count число участников барьера
+inline int spin_budget( std::ptrdiff_t thread_count )
+{
+    constexpr int max_spin_count = 4096;
+    return thread_count < static_cast< std::ptrdiff_t >( std::thread::hardware_concurrency() ) ? max_spin_count : 0;
+}
+
+inline void cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/// @brief Ждёт, пока phase не уйдёт со значения old
+/// Сначала крутится spin_count проверок, затем засыпает в std::atomic::wait
+inline void wait_phase_change( const std::atomic< std::uint32_t >& phase, std::uint32_t old, int spin_count )
+{
+    for ( int spin = 0; spin < spin_count; ++spin )
+    {
+        if ( phase.load( std::memory_order_acquire ) != old )
+        {
+            return;
+        }
+        cpu_relax();
+    }
+    while ( phase.load( std::memory_order_acquire ) == old )
+    {
+        phase.wait( old, std::memory_order_acquire );
+    }
+}
+
+} // namespace detail
+
+/// @brief Барьер со сменой фазы (sense-reversing)
+/// Прибывающие уменьшают один атомарный счётчик; последний вызывает
+/// callback, восстанавливает счётчик и переключает фазу. Ожидающие недолго
+/// крутятся на фазе, затем засыпают в std::atomic::wait.
 class barrier
 {
 public:
     using callback_fn = std::function< void() >;
+    using arrival_token = std::uint32_t;
 
 public:
-    barrier( uint16_t thread_count, callback_fn callback )
-        : mutex_()
-        , cv_()
-        , thread_count_( thread_count )
-        , count_ ( thread_count )
-        , waiting_count_ ( 0 )
+    /// @brief Конструктор
+    /// @param thread_count число участников
+    /// @param callback вызывается последним прибывшим в каждой фазе
+    barrier( std::ptrdiff_t thread_count, callback_fn callback )
+        : expected_( thread_count )
+        , count_( thread_count )
+        , phase_( 0 )
+        , spin_count_( detail::spin_budget( thread_count ) )
         , callback_( callback )
-
     {
         assert( thread_count > 0 );
         assert( callback );
@@ -34,6 +93,226 @@ public:
     barrier& operator=( barrier&& ) = delete;
     barrier& operator=( const barrier& ) = delete;
 
+public:
+    /// @brief Прибытие и ожидание конца фазы
+    void wait()
+    {
+        wait( arrive() );
+    }
+
+    /// @brief Прибытие без ожидания
+    /// @return Фаза, конца которой можно дождаться через wait( phase )
+    [[nodiscard]] arrival_token arrive()
+    {
+        auto phase = phase_.load( std::memory_order_acquire );
+        if ( count_.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        {
+            complete( phase );
+        }
+        return phase;
+    }
+
+    /// @brief Ожидание конца фазы phase
+    void wait( arrival_token phase ) const
+    {
+        detail::wait_phase_change( phase_, phase, spin_count_ );
+    }
+
+    /// @brief Прибытие и выход из числа участников со следующей фазы
+    void arrive_and_drop()
+    {
+        expected_.fetch_sub( 1, std::memory_order_relaxed );
+        ( void ) arrive();
+    }
+
+private:
+    void complete( arrival_token phase )
+    {
+        callback_();
+        count_.store( expected_.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        phase_.store( phase + 1, std::memory_order_release );
+        phase_.notify_all();
+    }
+
+private:
+    std::atomic< std::ptrdiff_t > expected_;
+    alignas( 64 ) std::atomic< std::ptrdiff_t > count_;
+    alignas( 64 ) std::atomic< arrival_token > phase_;
+    const int spin_count_;
+    callback_fn callback_;
+};
+
+/// @brief Барьер на дереве счётчиков (combining tree) для большого числа ядер
+/// Участник прибывает в лист, общий не более чем для fan_in участников;
+/// последний прибывший в узел передаёт прибытие родителю, так что за
+/// каждый счётчик борются не больше fan_in потоков. Последний прибывший в
+/// корень вызывает callback и переключает фазу, как в barrier. Участники
+/// передают свой номер из [0, thread_count).
+class tree_barrier
+{
+public:
+    using callback_fn = std::function< void() >;
+    using arrival_token = std::uint32_t;
+
+private:
+    static constexpr std::size_t no_parent = static_cast< std::size_t >( -1 );
+
+    struct alignas( 64 ) node
+    {
+        std::atomic< std::ptrdiff_t > count{ 0 };
+        std::atomic< std::ptrdiff_t > expected{ 0 };
+        std::size_t parent = no_parent;
+    };
+
+public:
+    /// @brief Конструктор
+    /// @param thread_count число участников
+    /// @param callback вызывается последним прибывшим в каждой фазе
+    /// @param fan_in число детей узла дерева
+    tree_barrier( std::ptrdiff_t thread_count, callback_fn callback, std::size_t fan_in = 4 )
+        : fan_in_( fan_in )
+        , phase_( 0 )
+        , spin_count_( detail::spin_budget( thread_count ) )
+        , callback_( callback )
+    {
+        assert( thread_count > 0 );
+        assert( fan_in > 1 );
+        assert( callback );
+
+        auto level_sizes = std::vector< std::size_t >{};
+        auto width = static_cast< std::size_t >( thread_count );
+        do
+        {
+            width = ( width + fan_in_ - 1 ) / fan_in_;
+            level_sizes.push_back( width );
+        } while ( width > 1 );
+
+        auto total = std::size_t{ 0 };
+        for ( auto size : level_sizes )
+        {
+            total += size;
+        }
+        nodes_ = std::make_unique< node[] >( total );
+
+        auto offset = std::size_t{ 0 };
+        auto children = static_cast< std::size_t >( thread_count );
+        for ( std::size_t level = 0; level < level_sizes.size(); ++level )
+        {
+            auto next_offset = offset + level_sizes[ level ];
+            for ( std::size_t j = 0; j < level_sizes[ level ]; ++j )
+            {
+                auto& current = nodes_[ offset + j ];
+                auto arrivals = static_cast< std::ptrdiff_t >( std::min( fan_in_, children - j * fan_in_ ) );
+                current.count.store( arrivals, std::memory_order_relaxed );
+                current.expected.store( arrivals, std::memory_order_relaxed );
+                current.parent = level + 1 < level_sizes.size() ? next_offset + j / fan_in_ : no_parent;
+            }
+            children = level_sizes[ level ];
+            offset = next_offset;
+        }
+    }
+    ~tree_barrier()
+    {}
+
+    tree_barrier( const tree_barrier& ) = delete;
+    tree_barrier( tree_barrier&& ) = delete;
+    tree_barrier& operator=( tree_barrier&& ) = delete;
+    tree_barrier& operator=( const tree_barrier& ) = delete;
+
+public:
+    /// @brief Прибытие участника participant и ожидание конца фазы
+    void arrive_and_wait( std::size_t participant )
+    {
+        wait( arrive( participant ) );
+    }
+
+    /// @brief Прибытие участника participant без ожидания
+    /// @return Фаза, конца которой можно дождаться через wait( phase )
+    [[nodiscard]] arrival_token arrive( std::size_t participant )
+    {
+        auto phase = phase_.load( std::memory_order_acquire );
+        arrive_at( participant / fan_in_, false, phase );
+        return phase;
+    }
+
+    /// @brief Ожидание конца фазы phase
+    void wait( arrival_token phase ) const
+    {
+        detail::wait_phase_change( phase_, phase, spin_count_ );
+    }
+
+    /// @brief Прибытие участника participant и его выход со следующей фазы
+    void arrive_and_drop( std::size_t participant )
+    {
+        arrive_at( participant / fan_in_, true, phase_.load( std::memory_order_acquire ) );
+    }
+
+private:
+    /// @brief Прибытие в узел index и, если оно последнее, вверх по дереву
+    /// Узел, у которого не осталось участников, больше не прибывает в
+    /// родителя, поэтому в той же фазе выбывает и из него
+    void arrive_at( std::size_t index, bool drop, arrival_token phase )
+    {
+        for ( ;; )
+        {
+            auto& current = nodes_[ index ];
+            if ( drop )
+            {
+                current.expected.fetch_sub( 1, std::memory_order_relaxed );
+            }
+            if ( current.count.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+            {
+                return;
+            }
+            auto next = current.expected.load( std::memory_order_relaxed );
+            current.count.store( next, std::memory_order_relaxed );
+            if ( current.parent == no_parent )
+            {
+                break;
+            }
+            drop = next == 0;
+            index = current.parent;
+        }
+        callback_();
+        phase_.store( phase + 1, std::memory_order_release );
+        phase_.notify_all();
+    }
+
+private:
+    const std::size_t fan_in_;
+    std::unique_ptr< node[] > nodes_;
+    alignas( 64 ) std::atomic< arrival_token > phase_;
+    const int spin_count_;
+    callback_fn callback_;
+};
+
+#ifdef BENCHMARK
+class mutex_barrier
+{
+public:
+    using callback_fn = std::function< void() >;
+
+public:
+    mutex_barrier( uint16_t thread_count, callback_fn callback )
+        : mutex_()
+        , cv_()
+        , count_ ( thread_count )
+        , thread_count_( thread_count )
+        , waiting_count_ ( 0 )
+        , callback_( callback )
+
+    {
+        assert( thread_count > 0 );
+        assert( callback );
+    }
+    ~mutex_barrier()
+    {}
+
+    mutex_barrier( const mutex_barrier& ) = delete;
+    mutex_barrier( mutex_barrier&& ) = delete;
+    mutex_barrier& operator=( mutex_barrier&& ) = delete;
+    mutex_barrier& operator=( const mutex_barrier& ) = delete;
+
 public:
     void wait()
     {
@@ -62,11 +341,89 @@ private:
     callback_fn callback_;
 };
 
+#endif
+
 } // namespace custom
 
+#ifdef BENCHMARK
+/// @return Число фаз в секунду для thread_count потоков
+template < class Barrier >
+double phases_per_second( Barrier& sync_point, std::ptrdiff_t thread_count, std::size_t phases )
+{
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve( thread_count );
+        for ( std::ptrdiff_t i = 0; i < thread_count; ++i )
+        {
+            threads.emplace_back( [ &, i ]
+            {
+                for ( std::size_t phase = 0; phase < phases; ++phase )
+                {
+                    if constexpr ( std::is_same_v< Barrier, custom::tree_barrier > )
+                    {
+                        sync_point.arrive_and_wait( static_cast< std::size_t >( i ) );
+                    }
+                    else if constexpr ( requires { sync_point.arrive_and_wait(); } )
+                    {
+                        sync_point.arrive_and_wait();
+                    }
+                    else
+                    {
+                        sync_point.wait();
+                    }
+                }
+            } );
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return phases / std::chrono::duration<double>( end - start ).count();
+}
+
+void run_barrier_benchmark()
+{
+    constexpr std::size_t phases = 20000;
+    auto noop = []() noexcept {};
+    std::cout << "threads,mutex_barrier,barrier,std::barrier" << std::endl;
+    for ( std::ptrdiff_t threads = 1; threads <= std::max<std::ptrdiff_t>( 2, std::thread::hardware_concurrency() ); threads *= 2 )
+    {
+        custom::mutex_barrier old_barrier( threads, noop );
+        custom::barrier new_barrier( threads, noop );
+        std::barrier std_barrier( threads, noop );
+        std::cout << threads
+            << ',' << phases_per_second( old_barrier, threads, phases )
+            << ',' << phases_per_second( new_barrier, threads, phases )
+            << ',' << phases_per_second( std_barrier, threads, phases ) << std::endl;
+    }
+}
+
+/// @brief Время фазы центрального барьера и барьера на дереве
+/// в зависимости от числа участников
+void run_scaling_benchmark()
+{
+    constexpr std::size_t phases = 5000;
+    auto noop = []() noexcept {};
+    auto max_threads = std::max<std::ptrdiff_t>( 64, std::thread::hardware_concurrency() );
+    std::cout << "threads,barrier_ns_per_phase,tree_barrier_ns_per_phase" << std::endl;
+    for ( std::ptrdiff_t threads = 1; threads <= max_threads; threads *= 2 )
+    {
+        custom::barrier central( threads, noop );
+        custom::tree_barrier tree( threads, noop );
+        std::cout << threads
+            << ',' << 1e9 / phases_per_second( central, threads, phases )
+            << ',' << 1e9 / phases_per_second( tree, threads, phases ) << std::endl;
+    }
+}
+#endif
+
 int main()
 try
 {
+#ifdef BENCHMARK
+    run_barrier_benchmark();
+    run_scaling_benchmark();
+#endif
+
     const auto workers = { "Anil", "Busara", "Carl" };
  
     auto on_completion = []() noexcept
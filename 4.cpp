@@ -21,136 +21,1220 @@ k “читающих” потоков считывают данные из ф
 #include <set>
 #include <algorithm>
 #include <map>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <iterator>
+#include <cstring>
+#include <chrono>
+#include <random>
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
 #include <omp.h>
+#include <string_view>
+#include <cerrno>
+#include <cctype>
+#include <bit>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "thread_pool.hpp"
+
+/// Подсчёт байтов для однобайтовых типов. Разброс инкрементов по 256
+/// ячейкам не векторизуется, поэтому ядра читают данные широкими словами
+/// и раскладывают байты по 4 независимым подгистограммам: соседние
+/// одинаковые байты не упираются в store-forwarding одного счётчика.
+/// AVX2/AVX-512 расширяют загрузку и сложение подгистограмм.
+namespace byte_histogram
+{
+
+using histogram_t = std::array< uint64_t, 256 >;
+using sub_histograms_t = std::array< std::array< uint32_t, 256 >, 4 >;
+
+// не даём 32-битным подсчётам переполниться на многогигабайтных буферах
+constexpr std::size_t flush_bytes = std::size_t{ 1 } << 30;
+
+inline void count_scalar( const unsigned char* data, std::size_t size, histogram_t& out )
+{
+    for ( std::size_t i = 0; i < size; ++i )
+    {
+        ++out[ data[ i ] ];
+    }
+}
+
+inline void tally_word( sub_histograms_t& sub, uint64_t word )
+{
+    ++sub[ 0 ][ word & 0xff ];
+    ++sub[ 1 ][ ( word >> 8 ) & 0xff ];
+    ++sub[ 2 ][ ( word >> 16 ) & 0xff ];
+    ++sub[ 3 ][ ( word >> 24 ) & 0xff ];
+    ++sub[ 0 ][ ( word >> 32 ) & 0xff ];
+    ++sub[ 1 ][ ( word >> 40 ) & 0xff ];
+    ++sub[ 2 ][ ( word >> 48 ) & 0xff ];
+    ++sub[ 3 ][ word >> 56 ];
+}
+
+inline void flush( sub_histograms_t& sub, histogram_t& out )
+{
+    for ( std::size_t i = 0; i < out.size(); ++i )
+    {
+        out[ i ] += uint64_t{ sub[ 0 ][ i ] } + sub[ 1 ][ i ] + sub[ 2 ][ i ] + sub[ 3 ][ i ];
+    }
+    sub = {};
+}
+
+inline void count_unrolled( const unsigned char* data, std::size_t size, histogram_t& out )
+{
+    alignas( 64 ) auto sub = sub_histograms_t{};
+    std::size_t i = 0;
+    while ( size - i >= sizeof( uint64_t ) )
+    {
+        auto block_end = i + std::min( flush_bytes, ( size - i ) & ~( sizeof( uint64_t ) - 1 ) );
+        for ( ; i < block_end; i += sizeof( uint64_t ) )
+        {
+            uint64_t word;
+            std::memcpy( &word, data + i, sizeof( word ) );
+            tally_word( sub, word );
+        }
+        flush( sub, out );
+    }
+    count_scalar( data + i, size - i, out );
+}
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+
+__attribute__(( target( "avx2" ) ))
+inline void flush_avx2( sub_histograms_t& sub, histogram_t& out )
+{
+    for ( std::size_t i = 0; i < out.size(); i += 8 )
+    {
+        auto sum = _mm256_add_epi32(
+            _mm256_add_epi32( _mm256_load_si256( reinterpret_cast<const __m256i*>( &sub[ 0 ][ i ] ) ),
+                              _mm256_load_si256( reinterpret_cast<const __m256i*>( &sub[ 1 ][ i ] ) ) ),
+            _mm256_add_epi32( _mm256_load_si256( reinterpret_cast<const __m256i*>( &sub[ 2 ][ i ] ) ),
+                              _mm256_load_si256( reinterpret_cast<const __m256i*>( &sub[ 3 ][ i ] ) ) ) );
+        auto* dst = reinterpret_cast<__m256i*>( &out[ i ] );
+        _mm256_storeu_si256( dst, _mm256_add_epi64( _mm256_loadu_si256( dst ),
+            _mm256_cvtepu32_epi64( _mm256_castsi256_si128( sum ) ) ) );
+        _mm256_storeu_si256( dst + 1, _mm256_add_epi64( _mm256_loadu_si256( dst + 1 ),
+            _mm256_cvtepu32_epi64( _mm256_extracti128_si256( sum, 1 ) ) ) );
+    }
+    sub = {};
+}
+
+__attribute__(( target( "avx2" ) ))
+inline void count_avx2( const unsigned char* data, std::size_t size, histogram_t& out )
+{
+    alignas( 64 ) auto sub = sub_histograms_t{};
+    std::size_t i = 0;
+    while ( size - i >= sizeof( __m256i ) )
+    {
+        auto block_end = i + std::min( flush_bytes, ( size - i ) & ~( sizeof( __m256i ) - 1 ) );
+        for ( ; i < block_end; i += sizeof( __m256i ) )
+        {
+            auto v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + i ) );
+            tally_word( sub, _mm256_extract_epi64( v, 0 ) );
+            tally_word( sub, _mm256_extract_epi64( v, 1 ) );
+            tally_word( sub, _mm256_extract_epi64( v, 2 ) );
+            tally_word( sub, _mm256_extract_epi64( v, 3 ) );
+        }
+        flush_avx2( sub, out );
+    }
+    count_scalar( data + i, size - i, out );
+}
+
+__attribute__(( target( "avx512f" ) ))
+inline void flush_avx512( sub_histograms_t& sub, histogram_t& out )
+{
+    for ( std::size_t i = 0; i < out.size(); i += 16 )
+    {
+        auto sum = _mm512_add_epi32(
+            _mm512_add_epi32( _mm512_load_si512( &sub[ 0 ][ i ] ), _mm512_load_si512( &sub[ 1 ][ i ] ) ),
+            _mm512_add_epi32( _mm512_load_si512( &sub[ 2 ][ i ] ), _mm512_load_si512( &sub[ 3 ][ i ] ) ) );
+        auto* dst = &out[ i ];
+        _mm512_storeu_si512( dst, _mm512_add_epi64( _mm512_loadu_si512( dst ),
+            _mm512_cvtepu32_epi64( _mm512_castsi512_si256( sum ) ) ) );
+        _mm512_storeu_si512( dst + 8, _mm512_add_epi64( _mm512_loadu_si512( dst + 8 ),
+            _mm512_cvtepu32_epi64( _mm512_extracti64x4_epi64( sum, 1 ) ) ) );
+    }
+    sub = {};
+}
+
+__attribute__(( target( "avx512f" ) ))
+inline void count_avx512( const unsigned char* data, std::size_t size, histogram_t& out )
+{
+    alignas( 64 ) auto sub = sub_histograms_t{};
+    std::size_t i = 0;
+    while ( size - i >= sizeof( __m512i ) )
+    {
+        auto block_end = i + std::min( flush_bytes, ( size - i ) & ~( sizeof( __m512i ) - 1 ) );
+        for ( ; i < block_end; i += sizeof( __m512i ) )
+        {
+            auto v = _mm512_loadu_si512( data + i );
+            auto lo = _mm512_castsi512_si256( v );
+            auto hi = _mm512_extracti64x4_epi64( v, 1 );
+            tally_word( sub, _mm_cvtsi128_si64( _mm256_castsi256_si128( lo ) ) );
+            tally_word( sub, _mm_extract_epi64( _mm256_castsi256_si128( lo ), 1 ) );
+            tally_word( sub, _mm_cvtsi128_si64( _mm256_extracti128_si256( lo, 1 ) ) );
+            tally_word( sub, _mm_extract_epi64( _mm256_extracti128_si256( lo, 1 ), 1 ) );
+            tally_word( sub, _mm_cvtsi128_si64( _mm256_castsi256_si128( hi ) ) );
+            tally_word( sub, _mm_extract_epi64( _mm256_castsi256_si128( hi ), 1 ) );
+            tally_word( sub, _mm_cvtsi128_si64( _mm256_extracti128_si256( hi, 1 ) ) );
+            tally_word( sub, _mm_extract_epi64( _mm256_extracti128_si256( hi, 1 ), 1 ) );
+        }
+        flush_avx512( sub, out );
+    }
+    count_scalar( data + i, size - i, out );
+}
+
+#endif
+
+using kernel_fn = void ( * )( const unsigned char*, std::size_t, histogram_t& );
+
+/// @return Лучшее ядро для текущего процессора, выбирается один раз
+inline kernel_fn select_kernel()
+{
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) )
+    {
+        return count_avx512;
+    }
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        return count_avx2;
+    }
+#endif
+    return count_unrolled;
+}
+
+/// @brief Добавляет частоты байтов [data, data + size) к out
+inline void count( const unsigned char* data, std::size_t size, histogram_t& out )
+{
+    static const auto kernel = select_kernel();
+    kernel( data, size, out );
+}
+
+} // namespace byte_histogram
+
+/// Счётчик на открытой адресации с линейным пробированием: ключи и
+/// частоты лежат в двух плоских массивах, без узлов и аллокаций на вставку.
+/// Не потокобезопасен.
+template < typename Key, typename Hash = std::hash< Key > >
+class FlatCounter
+{
+public:
+    explicit FlatCounter( std::size_t capacity = 64 )
+    {
+        rehash( std::bit_ceil( std::max<std::size_t>( capacity, 8 ) ) );
+    }
+
+    void add( const Key& key, uint64_t by = 1 )
+    {
+        if ( ( size_ + 1 ) * 4 > counts_.size() * 3 )
+        {
+            rehash( counts_.size() * 2 );
+        }
+        for ( auto i = slot( key ); ; i = ( i + 1 ) & mask_ )
+        {
+            if ( counts_[ i ] == 0 )
+            {
+                keys_[ i ] = key;
+                counts_[ i ] = by;
+                ++size_;
+                return;
+            }
+            if ( keys_[ i ] == key )
+            {
+                counts_[ i ] += by;
+                return;
+            }
+        }
+    }
+
+    template < typename Fn >
+    void for_each( Fn&& fn ) const
+    {
+        for ( std::size_t i = 0; i < counts_.size(); ++i )
+        {
+            if ( counts_[ i ] )
+            {
+                fn( keys_[ i ], counts_[ i ] );
+            }
+        }
+    }
+
+    std::size_t size() const { return size_; }
+
+    void clear()
+    {
+        std::fill( counts_.begin(), counts_.end(), 0 );
+        size_ = 0;
+    }
+
+private:
+    /// std::hash для целых - тождественная функция, поэтому перемешиваем
+    std::size_t slot( const Key& key ) const
+    {
+        return static_cast<std::size_t>( ( Hash{}( key ) * 0x9E3779B97F4A7C15ull ) >> shift_ );
+    }
+
+    void rehash( std::size_t capacity )
+    {
+        auto keys = std::exchange( keys_, std::vector< Key >( capacity ) );
+        auto counts = std::exchange( counts_, std::vector< uint64_t >( capacity ) );
+        mask_ = capacity - 1;
+        shift_ = 64 - std::countr_zero( capacity );
+        size_ = 0;
+        for ( std::size_t i = 0; i < counts.size(); ++i )
+        {
+            if ( counts[ i ] )
+            {
+                add( keys[ i ], counts[ i ] );
+            }
+        }
+    }
+
+private:
+    std::vector< Key > keys_;
+    std::vector< uint64_t > counts_;
+    std::size_t size_ = 0;
+    std::size_t mask_ = 0;
+    int shift_ = 0;
+};
+
+/// Последовательность из 1-3 кодовых точек Unicode, упакованная в 64 бита:
+/// по 21 биту на точку, хранится cp + 1, так что пустое поле - конец.
+struct Ngram
+{
+    static constexpr std::size_t max_length = 3;
+
+    uint64_t packed = 0;
+
+    static Ngram from( const char32_t* code_points, std::size_t length )
+    {
+        auto ret = Ngram{};
+        for ( std::size_t i = 0; i < length; ++i )
+        {
+            ret.packed |= static_cast<uint64_t>( std::min<char32_t>( code_points[ i ], 0x10FFFF ) + 1 ) << ( 21 * i );
+        }
+        return ret;
+    }
+
+    std::size_t length() const
+    {
+        std::size_t length = 0;
+        while ( length < max_length && field( length ) )
+        {
+            ++length;
+        }
+        return length;
+    }
+
+    char32_t at( std::size_t i ) const { return static_cast<char32_t>( field( i ) - 1 ); }
+
+    uint64_t field( std::size_t i ) const { return ( packed >> ( 21 * i ) ) & 0x1FFFFF; }
+
+    friend bool operator==( const Ngram&, const Ngram& ) = default;
+    friend auto operator<=>( const Ngram&, const Ngram& ) = default;
+
+    friend std::ostream& operator<<( std::ostream& out, const Ngram& ngram )
+    {
+        for ( std::size_t i = 0; i < ngram.length(); ++i )
+        {
+            auto cp = static_cast<uint32_t>( ngram.at( i ) );
+            if ( cp < 0x80 )
+            {
+                out << static_cast<char>( cp );
+            }
+            else if ( cp < 0x800 )
+            {
+                out << static_cast<char>( 0xC0 | ( cp >> 6 ) ) << static_cast<char>( 0x80 | ( cp & 0x3F ) );
+            }
+            else if ( cp < 0x10000 )
+            {
+                out << static_cast<char>( 0xE0 | ( cp >> 12 ) ) << static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) )
+                    << static_cast<char>( 0x80 | ( cp & 0x3F ) );
+            }
+            else
+            {
+                out << static_cast<char>( 0xF0 | ( cp >> 18 ) ) << static_cast<char>( 0x80 | ( ( cp >> 12 ) & 0x3F ) )
+                    << static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) ) << static_cast<char>( 0x80 | ( cp & 0x3F ) );
+            }
+        }
+        return out;
+    }
+};
+
+template <>
+struct std::hash< Ngram >
+{
+    std::size_t operator()( const Ngram& ngram ) const noexcept { return ngram.packed; }
+};
+
+/// Счётчики одного потока-читателя. Пишет только поток-владелец,
+/// запросы читают шарды всех потоков и сливают их.
+template<typename T>
+class FrequencyShard
+{
+public:
+    void add( const T& value, uint64_t by = 1 )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        counts_.add( value, by );
+        total_.store( total_.load( std::memory_order_relaxed ) + by, std::memory_order_relaxed );
+    }
+
+    template < typename It >
+    void add_range( It begin, It end )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        uint64_t added = 0;
+        std::for_each( begin, end, [&]( const T& v ) { counts_.add( v ); ++added; } );
+        total_.store( total_.load( std::memory_order_relaxed ) + added, std::memory_order_relaxed );
+    }
+
+    void add_counts( const FlatCounter< T >& counts )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        uint64_t added = 0;
+        counts.for_each( [&]( const T& value, uint64_t count ) { counts_.add( value, count ); added += count; } );
+        total_.store( total_.load( std::memory_order_relaxed ) + added, std::memory_order_relaxed );
+    }
+
+    uint64_t total() const
+    {
+        return total_.load( std::memory_order_relaxed );
+    }
+
+    void merge_into( std::map< T, uint64_t >& out ) const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        counts_.for_each( [&]( const T& value, uint64_t count ) { out[ value ] += count; } );
+    }
+
+private:
+    FlatCounter< T > counts_;
+    std::atomic<uint64_t> total_{ 0 };
+    mutable std::mutex mutex_;
+};
+
+/// Для однобайтовых типов шард - гистограмма из 256 счётчиков.
+/// Единственный писатель обновляет их без lock-префикса и мьютекса.
+template<typename T>
+    requires ( std::is_integral_v<T> && sizeof( T ) == 1 )
+class FrequencyShard<T>
+{
+public:
+    void add( const T& value, uint64_t by = 1 )
+    {
+        bump( static_cast<unsigned char>( value ), by );
+    }
+
+    void add_counts( const FlatCounter< T >& counts )
+    {
+        counts.for_each( [&]( const T& value, uint64_t count ) { bump( static_cast<unsigned char>( value ), count ); } );
+    }
+
+    template < typename It >
+    void add_range( It begin, It end )
+    {
+        auto local = byte_histogram::histogram_t{};
+        if constexpr ( std::contiguous_iterator<It> )
+        {
+            byte_histogram::count( reinterpret_cast<const unsigned char*>( std::to_address( begin ) ),
+                static_cast<std::size_t>( end - begin ), local );
+        }
+        else
+        {
+            std::for_each( begin, end, [&]( const T& v ) { ++local[ static_cast<unsigned char>( v ) ]; } );
+        }
+        for ( std::size_t i = 0; i < local.size(); ++i )
+        {
+            if ( local[ i ] )
+            {
+                bump( i, local[ i ] );
+            }
+        }
+    }
+
+    uint64_t total() const
+    {
+        return total_.load( std::memory_order_relaxed );
+    }
+
+    void merge_into( std::map< T, uint64_t >& out ) const
+    {
+        for ( std::size_t i = 0; i < counters_.size(); ++i )
+        {
+            if ( auto count = counters_[ i ].load( std::memory_order_relaxed ) )
+            {
+                out[ static_cast<T>( i ) ] += count;
+            }
+        }
+    }
+
+private:
+    void bump( std::size_t index, uint64_t by )
+    {
+        auto& counter = counters_[ index ];
+        counter.store( counter.load( std::memory_order_relaxed ) + by, std::memory_order_relaxed );
+        total_.store( total_.load( std::memory_order_relaxed ) + by, std::memory_order_relaxed );
+    }
+
+private:
+    std::array< std::atomic<uint64_t>, 256 > counters_{};
+    std::atomic<uint64_t> total_{ 0 };
+};
+
+/// Запросы отвечают по опубликованному снимку: слитые шарды, упорядоченные
+/// по убыванию частоты. Читатели только загружают указатель на снимок;
+/// слияние выполняет не более одного потока и только когда снимок устарел,
+/// поэтому ни запросы, ни читающие потоки не ждут друг друга.
 template<typename T>
 class FrequencyAnalyzer
 {
+public:
     struct Frequency
     {
         T value;
         uint64_t requency;
     };
 
+    struct Snapshot
+    {
+        /// По убыванию частоты, при равенстве - по значению
+        std::vector< Frequency > by_frequency;
+        std::map< T, uint64_t > counts;
+        uint64_t total = 0;
+        std::chrono::steady_clock::time_point taken;
+    };
+
+    using clock = std::chrono::steady_clock;
+
 public:
-    FrequencyAnalyzer() = default;
+    /// @param max_staleness возраст снимка, после которого запрос
+    /// пытается опубликовать новый
+    explicit FrequencyAnalyzer( clock::duration max_staleness = std::chrono::milliseconds( 10 ) )
+        : max_staleness_( max_staleness )
+        , snapshot_( std::make_shared< const Snapshot >() )
+    {
+    }
 
     ~FrequencyAnalyzer() = default;
 
 public:
     void insert( const T& value )
     {
-    std::lock_guard<std::mutex> lock( mutex_ );
-        ++map_[ value ];
-        map_.insert( value );
+        local_shard().add( value );
     }
 
     template < typename U >
     void insert_iterable( const U& value )
     {
-        std::lock_guard<std::mutex> lock( mutex_ );
-        std::for_each( value.begin(), value.end(), [&]( const T& v ) { ++map_[ v ]; } );
+        local_shard().add_range( value.begin(), value.end() );
     }
 
-    double get_p_of_occurrence( const T& value )
+    /// @brief Добавляет заранее подсчитанные частоты одним обращением к шарду
+    void insert_counts( const FlatCounter< T >& counts )
+    {
+        local_shard().add_counts( counts );
+    }
+
+    /// @return Число вставленных значений без слияния шардов
+    uint64_t total() const
     {
         uint64_t total = 0;
-        std::for_each(
-            map_.begin(),
-            map_.end(),
-            [&]( auto&& elem ) {
-                total += elem.second;
-            } );
-        return map_[ value ] / static_cast<double>( total );
+        std::lock_guard<std::mutex> lock( shards_mutex_ );
+        for ( auto&& [ thread, shard ] : shards_ )
+        {
+            total += shard->total();
+        }
+        return total;
+    }
+
+    double get_p_of_occurrence( const T& value ) const
+    {
+        auto snapshot = current();
+        if ( snapshot->total == 0 )
+        {
+            return 0.0;
+        }
+        auto it = snapshot->counts.find( value );
+        return ( it == snapshot->counts.end() ? 0 : it->second ) / static_cast<double>( snapshot->total );
     }
 
+    /// @return count самых частых значений
     std::vector<Frequency> get_first_top( uint16_t count ) const
     {
-        std::lock_guard<std::mutex> lock( mutex_ );
-        if ( count > map_.size() )
+        auto snapshot = current();
+        auto& sorted = snapshot->by_frequency;
+        auto n = std::min<std::size_t>( count, sorted.size() );
+        return { sorted.begin(), sorted.begin() + n };
+    }
+
+    /// @return count самых редких из встреченных значений, начиная с редчайшего
+    std::vector<Frequency> get_last_top( uint16_t count ) const
+    {
+        auto snapshot = current();
+        auto& sorted = snapshot->by_frequency;
+        auto n = std::min<std::size_t>( count, sorted.size() );
+        return { sorted.rbegin(), sorted.rbegin() + n };
+    }
+
+    /// @return Последний опубликованный снимок, обновлённый при устаревании
+    std::shared_ptr< const Snapshot > current() const
+    {
+        auto snapshot = snapshot_.load( std::memory_order_acquire );
+        if ( clock::now() - snapshot->taken > max_staleness_ )
         {
-            count = map_.size();
+            if ( auto fresh = try_publish() )
+            {
+                return fresh;
+            }
         }
+        return snapshot;
+    }
 
-        auto ret = std::vector< Frequency >{};
-        ret.reserve( count );
-        auto it = map_.begin();
-        int32_t counter = 0;
-        while ( counter++ < count )
+    /// @brief Сливает шарды и публикует новый снимок
+    /// Дожидается идущей публикации, поэтому после возврата снимок
+    /// учитывает все вставки, завершившиеся до вызова.
+    std::shared_ptr< const Snapshot > publish() const
+    {
+        std::lock_guard<std::mutex> lock( publish_mutex_ );
+        return publish_locked();
+    }
+
+private:
+    std::shared_ptr< const Snapshot > try_publish() const
+    {
+        std::unique_lock<std::mutex> lock( publish_mutex_, std::try_to_lock );
+        if ( !lock )
         {
-            ret.push_back( { it->first, it->second } );
-            ++it;
+            return nullptr;
         }
-        ret.resize( count );
-        return ret;
+        return publish_locked();
     }
 
-    std::vector<Frequency> get_last_top( uint16_t count ) const
+    std::shared_ptr< const Snapshot > publish_locked() const
     {
-        std::lock_guard<std::mutex> lock( mutex_ );
+        auto snapshot = std::make_shared< Snapshot >();
+        snapshot->taken = clock::now();
+        snapshot->counts = merge_shards();
+        snapshot->by_frequency.reserve( snapshot->counts.size() );
+        for ( auto&& [ value, count ] : snapshot->counts )
+        {
+            snapshot->by_frequency.push_back( { value, count } );
+            snapshot->total += count;
+        }
+        std::stable_sort( snapshot->by_frequency.begin(), snapshot->by_frequency.end(),
+            []( const Frequency& lhs, const Frequency& rhs ) { return lhs.requency > rhs.requency; } );
 
-        if ( count > map_.size() )
+        auto published = std::shared_ptr< const Snapshot >( std::move( snapshot ) );
+        snapshot_.store( published, std::memory_order_release );
+        return published;
+    }
+
+    /// @return Шард вызывающего потока; мьютекс берётся только при первом
+    /// обращении потока к этому анализатору
+    FrequencyShard<T>& local_shard()
+    {
+        thread_local struct
+        {
+            uint64_t owner = 0;
+            FrequencyShard<T>* shard = nullptr;
+        } cache;
+
+        if ( cache.owner == id_ )
         {
-            count = map_.size();
+            return *cache.shard;
         }
 
-        auto ret = std::vector< Frequency >{};
-        ret.reserve( count );
-        auto it = map_.rbegin();
-        int32_t counter = 0;
-        while ( counter++ < count )
+        std::lock_guard<std::mutex> lock( shards_mutex_ );
+        auto& shard = shards_[ std::this_thread::get_id() ];
+        if ( !shard )
         {
-            ret.push_back( { it->first, it->second } );
-            ++it;
+            shard = std::make_unique< FrequencyShard<T> >();
         }
-        ret.resize( count );
-        return ret;
+        cache.owner = id_;
+        cache.shard = shard.get();
+        return *shard;
+    }
+
+    std::map< T, uint64_t > merge_shards() const
+    {
+        auto merged = std::map< T, uint64_t >{};
+        std::lock_guard<std::mutex> lock( shards_mutex_ );
+        for ( auto&& [ thread, shard ] : shards_ )
+        {
+            shard->merge_into( merged );
+        }
+        return merged;
+    }
+
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> counter{ 0 };
+        return ++counter;
     }
 
 private:
-    std::map< T, uint64_t > map_;
-    mutable std::mutex mutex_;
+    const uint64_t id_ = next_id();
+    std::map< std::thread::id, std::unique_ptr< FrequencyShard<T> > > shards_;
+    mutable std::mutex shards_mutex_;
+
+private: // snapshot
+    const clock::duration max_staleness_;
+    mutable std::mutex publish_mutex_;
+    mutable std::atomic< std::shared_ptr< const Snapshot > > snapshot_;
+};
+
+/// Файл, отображённый в память только для чтения.
+/// Пустой (!mapped()) для каналов, stdin, пустых файлов и при ошибке mmap.
+class MappedFile
+{
+public:
+    explicit MappedFile( const std::string& filename )
+    {
+        auto fd = ::open( filename.c_str(), O_RDONLY );
+        if ( fd < 0 )
+        {
+            return;
+        }
+        struct stat info{};
+        if ( ::fstat( fd, &info ) == 0 && S_ISREG( info.st_mode ) && info.st_size > 0 )
+        {
+            auto* data = ::mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( data != MAP_FAILED )
+            {
+                // Подсказки - перечисление, а не флаги: задаются отдельными вызовами
+                ::madvise( data, info.st_size, MADV_SEQUENTIAL );
+                ::madvise( data, info.st_size, MADV_WILLNEED );
+                data_ = static_cast<const char*>( data );
+                size_ = info.st_size;
+            }
+        }
+        ::close( fd );
+    }
+
+    ~MappedFile()
+    {
+        if ( data_ )
+        {
+            ::munmap( const_cast<char*>( data_ ), size_ );
+        }
+    }
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    bool mapped() const { return data_ != nullptr; }
+
+    std::string_view view() const { return { data_, size_ }; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/// Потребитель кусков входных данных. Считает единицы (байты, кодовые
+/// точки, n-граммы), которые начинаются в data[0, owned); data может
+/// продолжаться ещё на lookahead байт, чтобы дочитать единицы на стыке.
+struct ChunkSink
+{
+    std::size_t lookahead = 0;
+    std::function< void( std::string_view data, std::size_t owned ) > consume;
+};
+
+/// Счёт кодовых точек UTF-8 (length == 1) или n-грамм из них.
+/// Кусок, начавшийся посреди последовательности, пропускает её хвост:
+/// её посчитал предыдущий кусок. Некорректные байты дают U+FFFD.
+class Utf8Counter
+{
+public:
+    explicit Utf8Counter( std::size_t length )
+        : length_( std::clamp<std::size_t>( length, 1, Ngram::max_length ) )
+    {
+    }
+
+    /// Запас за концом куска: дочитать начатую точку и ещё length - 1 точек
+    std::size_t lookahead() const { return 3 + 4 * ( length_ - 1 ); }
+
+    void count( std::string_view data, std::size_t owned, FrequencyAnalyzer< Ngram >& analyzer ) const
+    {
+        auto counts = FlatCounter< Ngram >{ 4096 };
+        auto ascii = std::array< uint64_t, 128 >{};
+        char32_t window[ Ngram::max_length ];
+        std::size_t starts[ Ngram::max_length ];
+        std::size_t filled = 0;
+
+        std::size_t pos = 0;
+        while ( pos < data.size() && is_continuation( data[ pos ] ) )
+        {
+            ++pos;
+        }
+        while ( pos < data.size() )
+        {
+            if ( length_ == 1 )
+            {
+                // ASCII-пробег: по 8 байт за проверку старших битов
+                while ( pos + sizeof( uint64_t ) <= owned )
+                {
+                    uint64_t word;
+                    std::memcpy( &word, data.data() + pos, sizeof( word ) );
+                    if ( word & 0x8080808080808080ull )
+                    {
+                        break;
+                    }
+                    for ( std::size_t i = 0; i < sizeof( word ); ++i, word >>= 8 )
+                    {
+                        ++ascii[ word & 0x7F ];
+                    }
+                    pos += sizeof( word );
+                }
+                if ( pos >= owned )
+                {
+                    break;
+                }
+            }
+
+            auto [ cp, size ] = decode( data, pos );
+            if ( filled == length_ )
+            {
+                std::move( window + 1, window + length_, window );
+                std::move( starts + 1, starts + length_, starts );
+                --filled;
+            }
+            window[ filled ] = cp;
+            starts[ filled ] = pos;
+            ++filled;
+            if ( filled == length_ )
+            {
+                if ( starts[ 0 ] >= owned )
+                {
+                    break;
+                }
+                if ( length_ == 1 && cp < 0x80 )
+                {
+                    ++ascii[ cp ];
+                }
+                else
+                {
+                    counts.add( Ngram::from( window, length_ ) );
+                }
+            }
+            pos += size;
+        }
+
+        for ( std::size_t i = 0; i < ascii.size(); ++i )
+        {
+            if ( ascii[ i ] )
+            {
+                char32_t cp = static_cast<char32_t>( i );
+                counts.add( Ngram::from( &cp, 1 ), ascii[ i ] );
+            }
+        }
+        analyzer.insert_counts( counts );
+    }
+
+private:
+    static bool is_continuation( char byte )
+    {
+        return ( static_cast<unsigned char>( byte ) & 0xC0 ) == 0x80;
+    }
+
+    /// @return Кодовая точка и длина последовательности в байтах
+    static std::pair< char32_t, std::size_t > decode( std::string_view data, std::size_t pos )
+    {
+        constexpr char32_t replacement = 0xFFFD;
+        auto lead = static_cast<unsigned char>( data[ pos ] );
+        if ( lead < 0x80 )
+        {
+            return { lead, 1 };
+        }
+        std::size_t size = lead >= 0xF0 && lead < 0xF5 ? 4 : lead >= 0xE0 && lead < 0xF0 ? 3 : lead >= 0xC2 && lead < 0xE0 ? 2 : 0;
+        if ( size == 0 || pos + size > data.size() )
+        {
+            return { replacement, 1 };
+        }
+        // Узкий диапазон второго байта отсекает overlong, суррогаты и точки выше U+10FFFF
+        auto second = static_cast<unsigned char>( data[ pos + 1 ] );
+        unsigned char low = lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+        unsigned char high = lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+        if ( second < low || second > high )
+        {
+            return { replacement, 1 };
+        }
+        char32_t cp = lead & ( 0x7F >> size );
+        for ( std::size_t i = 1; i < size; ++i )
+        {
+            if ( !is_continuation( data[ pos + i ] ) )
+            {
+                return { replacement, 1 };
+            }
+            cp = ( cp << 6 ) | ( static_cast<unsigned char>( data[ pos + i ] ) & 0x3F );
+        }
+        return { cp, size };
+    }
+
+private:
+    const std::size_t length_;
 };
 
 class FileReader
 {
 public:
+    /// Наибольший кусок отображённого файла на одну задачу
+    static constexpr std::size_t chunk_size = std::size_t{ 4 } << 20;
+
+    /// Наименьший кусок: мельче делить файл невыгодно
+    static constexpr std::size_t min_chunk_size = std::size_t{ 256 } << 10;
+
+    /// Размер переиспользуемого буфера для каналов и stdin
+    static constexpr std::size_t stream_buffer_size = std::size_t{ 1 } << 20;
+
     ~FileReader() = default;
 
-    FileReader( FrequencyAnalyzer<char>& analyzer, std::vector< std::string >& filenames  )
+    /// @param filenames список файлов, "-" означает stdin
+    /// Дожидается, пока все файлы будут прочитаны.
+    FileReader( custom::thread_pool& pool, FrequencyAnalyzer<char>& analyzer, std::vector< std::string >& filenames  )
+        : FileReader( pool, byte_sink( analyzer ), filenames )
+    {
+    }
+
+    FileReader( custom::thread_pool& pool, ChunkSink sink, const std::vector< std::string >& filenames )
+    {
+        auto tasks = schedule( pool, std::move( sink ), filenames );
+        for ( auto&& task : tasks )
+        {
+            pool.wait( task );
+        }
+    }
+
+    /// @brief Потребитель, считающий байты в analyzer
+    static ChunkSink byte_sink( FrequencyAnalyzer<char>& analyzer )
+    {
+        return { 0, [ &analyzer ]( std::string_view data, std::size_t owned ) { count( analyzer, data.substr( 0, owned ) ); } };
+    }
+
+    /// @brief Потребитель, считающий кодовые точки или n-граммы UTF-8
+    static ChunkSink utf8_sink( FrequencyAnalyzer< Ngram >& analyzer, std::size_t length )
     {
+        auto counter = Utf8Counter{ length };
+        return { counter.lookahead(), [ &analyzer, counter ]( std::string_view data, std::size_t owned )
+        {
+            counter.count( data, owned, analyzer );
+        } };
+    }
+
+    static std::vector< std::future< void > > schedule(
+        custom::thread_pool& pool, FrequencyAnalyzer<char>& analyzer, const std::vector< std::string >& filenames )
+    {
+        return schedule( pool, byte_sink( analyzer ), filenames );
+    }
 
+    /// @brief Ставит чтение файлов в пул, не дожидаясь его окончания
+    /// Большие файлы режутся на куски, чтобы их читали все потоки пула,
+    /// маленькие собираются в пачки примерно по chunk_size байт на задачу.
+    /// @return Задачи чтения; всё, на что ссылается sink, должно их пережить
+    static std::vector< std::future< void > > schedule(
+        custom::thread_pool& pool, ChunkSink sink, const std::vector< std::string >& filenames )
+    {
         auto checked_filenames = std::set< std::string >{ filenames.begin(), filenames.end() };
+        auto page = static_cast<std::size_t>( ::sysconf( _SC_PAGESIZE ) );
+        auto shared_sink = std::make_shared< const ChunkSink >( std::move( sink ) );
+
+        auto tasks = std::vector < std::future< void > >{};
+        auto batch = std::vector< std::string >{};
+        auto batch_bytes = std::size_t{ 0 };
+        auto flush_batch = [ & ]
+        {
+            if ( !batch.empty() )
+            {
+                tasks.push_back( pool.submit( [ shared_sink, files = std::move( batch ) ]
+                {
+                    for ( auto&& filename : files )
+                    {
+                        read_whole( *shared_sink, filename );
+                    }
+                } ) );
+                batch = {};
+                batch_bytes = 0;
+            }
+        };
 
-        auto threads = std::vector < std::jthread >{};
         for ( auto&& filename : checked_filenames )
         {
-            threads.emplace_back(
-                [&]
+            struct stat info{};
+            if ( filename == "-" || ::stat( filename.c_str(), &info ) != 0 || !S_ISREG( info.st_mode ) )
+            {
+                tasks.push_back( pool.submit( [ shared_sink, filename ] { stream( *shared_sink, filename ); } ) );
+                continue;
+            }
+
+            auto size = static_cast<std::size_t>( info.st_size );
+            auto step = split_step( size, pool.size(), page );
+            if ( size <= step )
+            {
+                batch.push_back( filename );
+                batch_bytes += size;
+                if ( batch_bytes >= chunk_size )
                 {
-                    auto file = std::ifstream{ filename, std::ios::in };
-                    if ( !file )
+                    flush_batch();
+                }
+                continue;
+            }
+
+            auto file = std::make_shared< MappedFile >( filename );
+            if ( !file->mapped() )
+            {
+                tasks.push_back( pool.submit( [ shared_sink, filename ] { stream( *shared_sink, filename ); } ) );
+                continue;
+            }
+            auto whole = file->view();
+            for ( std::size_t offset = 0; offset < whole.size(); offset += step )
+            {
+                tasks.push_back( pool.submit(
+                    [ shared_sink, file, chunk = whole.substr( offset, step + shared_sink->lookahead ),
+                      owned = std::min( step, whole.size() - offset ) ]
                     {
-                        std::cerr << "Error: \"" << filename << "\" was not open" << std::endl;
+                        shared_sink->consume( chunk, owned );
                     }
-                    #ifdef INSERT_ITERABLE
-                        auto out = std::ostringstream{};
-                        out << file.rdbuf();
-                        analyzer.insert_iterable( out.str() );
-                    #else
-                        char ch;
-                        while ( file.get( ch ) )
-                        {
-                            analyzer.insert( ch );
-                        }
-                    #endif
+                ) );
+            }
+        }
+        flush_batch();
+        return tasks;
+    }
+
+private:
+    static void count( FrequencyAnalyzer<char>& analyzer, std::string_view chunk )
+    {
+        #ifdef INSERT_ITERABLE
+            analyzer.insert_iterable( chunk );
+        #else
+            for ( auto ch : chunk )
+            {
+                analyzer.insert( ch );
+            }
+        #endif
+    }
+
+    /// @return Размер куска, кратный странице: около четырёх кусков
+    /// на рабочий поток, но в пределах [min_chunk_size, chunk_size]
+    static std::size_t split_step( std::size_t size, std::size_t workers, std::size_t page )
+    {
+        auto step = std::clamp( size / ( workers * 4 ), min_chunk_size, chunk_size );
+        return std::max( step / page * page, page );
+    }
+
+    static void read_whole( const ChunkSink& sink, const std::string& filename )
+    {
+        auto file = MappedFile{ filename };
+        if ( file.mapped() )
+        {
+            sink.consume( file.view(), file.view().size() );
+        }
+        else
+        {
+            stream( sink, filename );
+        }
+    }
+
+    /// Чтение через read() в один переиспользуемый буфер. Последние
+    /// lookahead байт не отдаются, а переносятся в начало следующего куска.
+    static void stream( const ChunkSink& sink, const std::string& filename )
+    {
+        auto fd = filename == "-" ? STDIN_FILENO : ::open( filename.c_str(), O_RDONLY );
+        if ( fd < 0 )
+        {
+            std::cerr << "Error: \"" << filename << "\" was not open" << std::endl;
+            return;
+        }
+        auto buffer = std::vector< char >( std::max( stream_buffer_size, 2 * sink.lookahead ) );
+        std::size_t carried = 0;
+        for ( ;; )
+        {
+            auto got = ::read( fd, buffer.data() + carried, buffer.size() - carried );
+            if ( got < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            if ( got <= 0 )
+            {
+                if ( got < 0 )
+                {
+                    std::cerr << "Error: \"" << filename << "\" read failed" << std::endl;
                 }
-            );
+                break;
+            }
+            auto filled = carried + static_cast<std::size_t>( got );
+            if ( filled <= sink.lookahead )
+            {
+                carried = filled;
+                continue;
+            }
+            auto owned = filled - sink.lookahead;
+            sink.consume( std::string_view{ buffer.data(), filled }, owned );
+            std::memmove( buffer.data(), buffer.data() + owned, filled - owned );
+            carried = filled - owned;
+        }
+        if ( carried )
+        {
+            sink.consume( std::string_view{ buffer.data(), carried }, carried );
+        }
+        if ( fd != STDIN_FILENO )
+        {
+            ::close( fd );
         }
     }
 };
 
-void run()
+#ifdef BENCHMARK
+/// @brief Скорость подсчёта байтов в ГБ/с: map-путь против ядер гистограммы
+void run_histogram_benchmark()
+{
+    constexpr std::size_t size = ( std::size_t{ 1 } << 26 ) + 13;
+    auto data = std::vector< unsigned char >( size );
+    auto rng = std::mt19937_64{ 42 };
+    std::for_each( data.begin(), data.end(), [&]( auto& byte ) { byte = static_cast<unsigned char>( rng() % 64 + 32 ); } );
+
+    auto gbps = [&]( const char* name, auto&& kernel )
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto histogram = kernel();
+        auto end = std::chrono::steady_clock::now();
+        std::cout << name << ": " << size / std::chrono::duration<double>( end - start ).count() / 1e9 << " GB/s" << std::endl;
+        return histogram;
+    };
+    auto run_kernel = [&]( byte_histogram::kernel_fn kernel )
+    {
+        return [ &, kernel ]
+        {
+            auto histogram = byte_histogram::histogram_t{};
+            kernel( data.data(), data.size(), histogram );
+            return histogram;
+        };
+    };
+
+    auto expected = gbps( "std::map", [&]
+    {
+        auto map = std::map< unsigned char, uint64_t >{};
+        std::for_each( data.begin(), data.end(), [&]( unsigned char v ) { ++map[ v ]; } );
+        auto histogram = byte_histogram::histogram_t{};
+        for ( auto&& [ value, count ] : map )
+        {
+            histogram[ value ] = count;
+        }
+        return histogram;
+    } );
+
+    auto check = [&]( const byte_histogram::histogram_t& histogram )
+    {
+        if ( histogram != expected )
+        {
+            std::cerr << "Error: histogram mismatch" << std::endl;
+        }
+    };
+    check( gbps( "scalar", run_kernel( byte_histogram::count_scalar ) ) );
+    check( gbps( "unrolled", run_kernel( byte_histogram::count_unrolled ) ) );
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        check( gbps( "avx2", run_kernel( byte_histogram::count_avx2 ) ) );
+    }
+    if ( __builtin_cpu_supports( "avx512f" ) )
+    {
+        check( gbps( "avx512", run_kernel( byte_histogram::count_avx512 ) ) );
+    }
+#endif
+    check( gbps( "FrequencyAnalyzer<unsigned char>", [&]
+    {
+        auto analyzer = FrequencyAnalyzer< unsigned char >{};
+        analyzer.insert_iterable( data );
+        auto histogram = byte_histogram::histogram_t{};
+        for ( auto&& frequency : analyzer.publish()->by_frequency )
+        {
+            histogram[ frequency.value ] = frequency.requency;
+        }
+        return histogram;
+    } ) );
+}
+
+/// @brief Некорректные последовательности UTF-8 дают U+FFFD на каждый байт
+void check_utf8_decoder()
+{
+    struct case_t
+    {
+        std::string_view input;
+        char32_t code_point;
+        uint64_t count;
+    };
+    const case_t cases[] = {
+        { "\xF8\x80\x80\xFF\x80\x80", 0xFFFD, 6 },
+        { "\xE0\x80\x80", 0xFFFD, 3 },
+        { "\xF0\x80\x80\x80", 0xFFFD, 4 },
+        { "\xED\xA0\x80", 0xFFFD, 3 },
+        { "\xF4\x90\x80\x80", 0xFFFD, 4 },
+        { "\xE0\xA0\x80", 0x800, 1 },
+        { "\xED\x9F\xBF", 0xD7FF, 1 },
+        { "\xF0\x90\x80\x80", 0x10000, 1 },
+        { "\xF4\x8F\xBF\xBF", 0x10FFFF, 1 },
+    };
+    for ( auto&& [ input, code_point, count ] : cases )
+    {
+        auto analyzer = FrequencyAnalyzer< Ngram >{};
+        Utf8Counter{ 1 }.count( input, input.size(), analyzer );
+        auto expected = std::map< Ngram, uint64_t >{ { Ngram::from( &code_point, 1 ), count } };
+        if ( analyzer.publish()->counts != expected )
+        {
+            std::cerr << "Error: utf8 decode mismatch, expected U+" << std::hex << static_cast<uint32_t>( code_point )
+                << std::dec << " x" << count << std::endl;
+        }
+    }
+}
+
+/// @brief Запросы top-5 из отдельного потока во время загрузки данных
+void run_live_query_benchmark()
+{
+    constexpr std::size_t size = std::size_t{ 1 } << 24;
+    constexpr std::size_t rounds = 16;
+    auto data = std::string( size, '\0' );
+    auto rng = std::mt19937_64{ 7 };
+    std::for_each( data.begin(), data.end(), [&]( auto& ch ) { ch = static_cast<char>( 'a' + rng() % 26 ); } );
+
+    auto analyzer = FrequencyAnalyzer< char >{};
+    auto done = std::atomic<bool>{ false };
+    uint64_t queries = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto interface = std::jthread{ [&]
+        {
+            while ( !done.load( std::memory_order_relaxed ) )
+            {
+                queries += analyzer.get_first_top( 5 ).size() > 0 ? 1 : 0;
+            }
+        } };
+        for ( std::size_t round = 0; round < rounds; ++round )
+        {
+            analyzer.insert_iterable( std::string_view{ data } );
+        }
+        done = true;
+    }
+    auto seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    std::cout << "ingest under queries: " << size * rounds / seconds / 1e9 << " GB/s, "
+        << queries / seconds << " queries/s" << std::endl;
+}
+#endif
+
+void run( std::size_t worker_count, std::vector< std::string > list_of_files )
 {
     #ifdef INSERT_ITERABLE
         std::cout << "checking insert_iterable" << std::endl;
@@ -158,9 +1242,10 @@ void run()
         std::cout << "checking single insert" << std::endl;
     #endif
 
-    auto list_of_files = std::vector< std::string > { "./garbage.txt", "./garbage_2.txt" };
     auto analyzer = std::make_unique<FrequencyAnalyzer<char>>();
-    FileReader { *analyzer, list_of_files };
+    auto pool = custom::thread_pool{ worker_count };
+    FileReader { pool, *analyzer, list_of_files };
+    analyzer->publish();
     auto p_chars = analyzer->get_last_top( 2 );
     for( auto&& p_char : p_chars )
     {
@@ -176,8 +1261,180 @@ void run()
     std::cout << "Done\n";
 }
 
-int main() try {
-    run();
+/// Частоты кодовых точек UTF-8 (length == 1) или биграмм/триграмм
+void run_utf8( std::size_t worker_count, const std::vector< std::string >& list_of_files, std::size_t length )
+{
+    auto analyzer = std::make_unique< FrequencyAnalyzer< Ngram > >();
+    auto pool = custom::thread_pool{ worker_count };
+    FileReader { pool, FileReader::utf8_sink( *analyzer, length ), list_of_files };
+    auto snapshot = analyzer->publish();
+
+    std::cout << "total: " << snapshot->total << " | distinct: " << snapshot->counts.size() << std::endl;
+    std::cout << "top 5:" << std::endl;
+    for ( auto&& frequency : analyzer->get_first_top( 5 ) )
+    {
+        std::cout << "\"" << frequency.value << "\" " << frequency.requency << std::endl;
+    }
+    std::cout << "rarest 3:" << std::endl;
+    for ( auto&& frequency : analyzer->get_last_top( 3 ) )
+    {
+        std::cout << "\"" << frequency.value << "\" " << frequency.requency << std::endl;
+    }
+}
+
+/// Поток-интерфейс: команды читаются из stdin, пока пул продолжает
+/// загружать файлы. Каждый ответ сопровождается временем его подготовки.
+void run_interactive( std::size_t worker_count, const std::vector< std::string >& list_of_files )
+{
+    using clock = std::chrono::steady_clock;
+
+    auto analyzer = std::make_unique<FrequencyAnalyzer<char>>();
+    auto pool = custom::thread_pool{ worker_count };
+    auto tasks = FileReader::schedule( pool, *analyzer, list_of_files );
+
+    auto started = clock::now();
+    auto last_stats = started;
+    auto last_total = uint64_t{ 0 };
+
+    auto print = []( auto&& frequencies )
+    {
+        for ( auto&& frequency : frequencies )
+        {
+            std::cout << "'" << frequency.value << "' " << frequency.requency << std::endl;
+        }
+    };
+
+    std::cout << "commands: top N | rare N | p <char> | add <file> | stats | quit" << std::endl;
+    auto line = std::string{};
+    while ( std::cout << "> " << std::flush, std::getline( std::cin, line ) )
+    {
+        auto in = std::istringstream{ line };
+        auto command = std::string{};
+        if ( !( in >> command ) )
+        {
+            continue;
+        }
+
+        auto start = clock::now();
+        if ( command == "top" || command == "rare" )
+        {
+            auto count = uint16_t{ 5 };
+            in >> count;
+            print( command == "top" ? analyzer->get_first_top( count ) : analyzer->get_last_top( count ) );
+        }
+        else if ( command == "p" )
+        {
+            auto ch = char{};
+            if ( !( in >> std::noskipws >> std::ws >> ch ) )
+            {
+                std::cout << "usage: p <char>" << std::endl;
+                continue;
+            }
+            std::cout << "p('" << ch << "') = " << analyzer->get_p_of_occurrence( ch ) << std::endl;
+        }
+        else if ( command == "add" )
+        {
+            auto filenames = std::vector< std::string >{};
+            for ( auto filename = std::string{}; in >> filename; )
+            {
+                filenames.push_back( filename );
+            }
+            auto added = FileReader::schedule( pool, *analyzer, filenames );
+            std::move( added.begin(), added.end(), std::back_inserter( tasks ) );
+        }
+        else if ( command == "stats" )
+        {
+            auto now = clock::now();
+            auto total = analyzer->total();
+            auto pending = std::count_if( tasks.begin(), tasks.end(), []( auto&& task )
+            {
+                return task.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready;
+            } );
+            auto snapshot = analyzer->current();
+            std::cout << "chars: " << total
+                << " | rate: " << ( total - last_total ) / std::chrono::duration<double>( now - last_stats ).count() / 1e6 << " MB/s"
+                << " | average: " << total / std::chrono::duration<double>( now - started ).count() / 1e6 << " MB/s"
+                << " | pending tasks: " << pending
+                << " | snapshot age: " << std::chrono::duration<double, std::milli>( now - snapshot->taken ).count() << " ms"
+                << std::endl;
+            last_stats = now;
+            last_total = total;
+        }
+        else if ( command == "quit" )
+        {
+            break;
+        }
+        else
+        {
+            std::cout << "unknown command: " << command << std::endl;
+            continue;
+        }
+        std::cout << "(" << std::chrono::duration<double, std::micro>( clock::now() - start ).count() << " us)" << std::endl;
+    }
+
+    for ( auto&& task : tasks )
+    {
+        pool.wait( task );
+    }
+}
+
+/// Использование: 4 [worker_count] [--interactive | --utf8 | --ngram=2|3] [files...]
+int main( int argc, char** argv ) try {
+#ifdef BENCHMARK
+    check_utf8_decoder();
+    run_histogram_benchmark();
+    run_live_query_benchmark();
+#endif
+    auto worker_count = std::size_t{ std::max( 1u, std::thread::hardware_concurrency() ) };
+    auto interactive = false;
+    auto ngram_length = std::size_t{ 0 };
+    auto list_of_files = std::vector< std::string >{};
+    for ( int i = 1; i < argc; ++i )
+    {
+        auto arg = std::string_view{ argv[ i ] };
+        if ( arg == "--interactive" )
+        {
+            interactive = true;
+        }
+        else if ( arg == "--utf8" )
+        {
+            ngram_length = 1;
+        }
+        else if ( arg.starts_with( "--ngram=" ) )
+        {
+            auto value = arg.substr( 8 );
+            if ( value.size() != 1 || value[ 0 ] < '1' || value[ 0 ] > '0' + static_cast<int>( Ngram::max_length ) )
+            {
+                throw std::invalid_argument( "Error: \"--ngram expects N from 1 to " + std::to_string( Ngram::max_length ) + "\"" );
+            }
+            ngram_length = static_cast<std::size_t>( value[ 0 ] - '0' );
+        }
+        else if ( i == 1 && std::all_of( arg.begin(), arg.end(), []( unsigned char c ) { return std::isdigit( c ); } ) )
+        {
+            worker_count = std::stoul( argv[ i ] );
+        }
+        else
+        {
+            list_of_files.emplace_back( arg );
+        }
+    }
+    if ( list_of_files.empty() )
+    {
+        list_of_files = { "./garbage.txt", "./garbage_2.txt" };
+    }
+
+    if ( ngram_length )
+    {
+        run_utf8( worker_count, list_of_files, ngram_length );
+    }
+    else if ( interactive )
+    {
+        run_interactive( worker_count, list_of_files );
+    }
+    else
+    {
+        run( worker_count, list_of_files );
+    }
     return EXIT_SUCCESS;
 }
 catch (const std::exception& e) {
@@ -8,33 +8,327 @@
 #include <chrono>
 #include <algorithm>
 #include <random>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include "parallel_reduce.hpp"
+#include "random.hpp"
 
 namespace
 {
 
-int32_t dot_product( const std::vector<int32_t>& a, const std::vector<int32_t>& b )
+/// Скалярное произведение: явная SIMD-редукция в несколько независимых
+/// аккумуляторов, целые расширяются до int64, вещественные складываются
+/// по Кэхэну или попарно. Блоки векторов раздаёт custom::reduce_blocks.
+namespace dot
+{
+
+/// Тип накопителя по умолчанию: целые - int64, вещественные - свой тип
+template < typename T >
+using accumulator_t = std::conditional_t< std::is_integral_v< T >, int64_t, T >;
+
+enum class summation
+{
+    /// Обычное сложение в аккумуляторах
+    naive,
+    /// Сложение с компенсацией Кэхэна в каждом аккумуляторе и между блоками
+    kahan,
+    /// Суммы блоков складываются попарно деревом
+    pairwise,
+};
+
+template < typename Acc >
+void kahan_add( Acc& sum, Acc& compensation, Acc value )
+{
+    const Acc y = value - compensation;
+    const Acc t = sum + y;
+    compensation = ( t - sum ) - y;
+    sum = t;
+}
+
+/// @brief Сумма a[ i ] * b[ i ] по регистрам шириной Bytes
+/// unroll независимых векторных аккумуляторов разрывают зависимость по
+/// сложению; входы расширяются до Acc до умножения, так что int32 * int32
+/// не переполняется.
+template < typename T, typename Acc, std::size_t Bytes, bool Compensated >
+[[gnu::always_inline]] inline Acc simd_dot( const T* a, const T* b, std::size_t n )
+{
+    constexpr std::size_t lanes = Bytes / sizeof( Acc );
+    constexpr std::size_t unroll = 4;
+    typedef Acc acc_vec __attribute__(( vector_size( Bytes ) ));
+    typedef T in_vec __attribute__(( vector_size( lanes * sizeof( T ) ), aligned( alignof( T ) ) ));
+
+    acc_vec sum[ unroll ] = {};
+    acc_vec compensation[ unroll ] = {};
+    std::size_t i = 0;
+    for ( ; i + unroll * lanes <= n; i += unroll * lanes )
+    {
+        for ( std::size_t u = 0; u < unroll; ++u )
+        {
+            in_vec x, y;
+            std::memcpy( &x, a + i + u * lanes, sizeof( x ) );
+            std::memcpy( &y, b + i + u * lanes, sizeof( y ) );
+            const acc_vec product = __builtin_convertvector( x, acc_vec ) * __builtin_convertvector( y, acc_vec );
+            if constexpr ( Compensated )
+            {
+                const acc_vec v = product - compensation[ u ];
+                const acc_vec t = sum[ u ] + v;
+                compensation[ u ] = ( t - sum[ u ] ) - v;
+                sum[ u ] = t;
+            }
+            else
+            {
+                sum[ u ] += product;
+            }
+        }
+    }
+
+    Acc total{};
+    Acc total_compensation{};
+    for ( std::size_t u = 0; u < unroll; ++u )
+    {
+        for ( std::size_t l = 0; l < lanes; ++l )
+        {
+            if constexpr ( Compensated )
+            {
+                kahan_add( total, total_compensation, sum[ u ][ l ] );
+                kahan_add( total, total_compensation, -compensation[ u ][ l ] );
+            }
+            else
+            {
+                total += sum[ u ][ l ];
+            }
+        }
+    }
+    for ( ; i < n; ++i )
+    {
+        const Acc product = static_cast< Acc >( a[ i ] ) * static_cast< Acc >( b[ i ] );
+        if constexpr ( Compensated )
+        {
+            kahan_add( total, total_compensation, product );
+        }
+        else
+        {
+            total += product;
+        }
+    }
+    return total - total_compensation;
+}
+
+template < typename T, typename Acc, bool Compensated >
+using kernel_fn = Acc ( * )( const T*, const T*, std::size_t );
+
+template < typename T, typename Acc, bool Compensated >
+Acc dot_generic( const T* a, const T* b, std::size_t n )
+{
+    return simd_dot< T, Acc, 16, Compensated >( a, b, n );
+}
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+
+template < typename T, typename Acc, bool Compensated >
+[[gnu::target( "avx2" )]]
+Acc dot_avx2( const T* a, const T* b, std::size_t n )
+{
+    return simd_dot< T, Acc, 32, Compensated >( a, b, n );
+}
+
+template < typename T, typename Acc, bool Compensated >
+[[gnu::target( "avx512f,avx512bw,avx512dq,avx512vl" )]]
+Acc dot_avx512( const T* a, const T* b, std::size_t n )
+{
+    return simd_dot< T, Acc, 64, Compensated >( a, b, n );
+}
+
+#endif
+
+/// @return Самое широкое ядро, которое поддерживает процессор
+template < typename T, typename Acc, bool Compensated >
+kernel_fn< T, Acc, Compensated > select()
+{
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" )
+        && __builtin_cpu_supports( "avx512dq" ) && __builtin_cpu_supports( "avx512vl" ) )
+    {
+        return dot_avx512< T, Acc, Compensated >;
+    }
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        return dot_avx2< T, Acc, Compensated >;
+    }
+#endif
+    return dot_generic< T, Acc, Compensated >;
+}
+
+/// Сумма с накопленной поправкой Кэхэна
+template < typename Acc >
+struct compensated
+{
+    Acc sum{};
+    Acc compensation{};
+
+    friend compensated operator+( compensated x, const compensated& y )
+    {
+        kahan_add( x.sum, x.compensation, y.sum );
+        kahan_add( x.sum, x.compensation, -y.compensation );
+        return x;
+    }
+};
+
+/// @brief Скалярное произведение с выбираемой точностью
+/// @param mode способ суммирования, для целых не важен: сумма точна,
+/// пока помещается в Acc
+/// @param options бэкенд, число потоков и размер блока; для pairwise
+/// порядок сложения всегда детерминирован
+/// @return Сумма a[ i ] * b[ i ] в типе Acc
+template < typename T, typename Acc = accumulator_t< T > >
+Acc product( const std::vector< T >& a, const std::vector< T >& b, summation mode = summation::pairwise,
+    custom::reduce_options options = {} )
+{
+    assert( a.size() == b.size() );
+    static_assert( std::is_arithmetic_v< T > && std::is_arithmetic_v< Acc > );
+    if constexpr ( std::is_integral_v< Acc > )
+    {
+        mode = summation::naive;
+    }
+
+    if ( mode == summation::kahan )
+    {
+        static const auto kernel = select< T, Acc, true >();
+        auto result = custom::reduce_blocks( a.size(), compensated< Acc >{}, std::plus<>{},
+            [ & ]( std::size_t begin, std::size_t end )
+            {
+                return compensated< Acc >{ kernel( a.data() + begin, b.data() + begin, end - begin ) };
+            }, options );
+        return result.sum - result.compensation;
+    }
+
+    static const auto kernel = select< T, Acc, false >();
+    options.deterministic = options.deterministic || mode == summation::pairwise;
+    return custom::reduce_blocks( a.size(), Acc{}, std::plus<>{},
+        [ & ]( std::size_t begin, std::size_t end )
+        {
+            return kernel( a.data() + begin, b.data() + begin, end - begin );
+        }, options );
+}
+
+} // namespace dot
+
+int64_t dot_product( const std::vector<int32_t>& a, const std::vector<int32_t>& b )
+{
+    return dot::product( a, b );
+}
+
+/// @brief size значений из [0, 9], потоки заполняют куски параллельно
+/// @param stream разные векторы с одним seed берут разные потоки генератора
+void fill_w_rand( std::vector<int32_t>& arr, std::size_t size, uint64_t seed, uint64_t stream )
+{
+    arr.resize( size );
+    custom::parallel_fill_uniform< int32_t >( arr.data(), size, 0, 9, seed, stream );
+}
+
+#ifdef BENCHMARK
+/// Прежняя реализация: сумма в int32 и автовекторизация OpenMP
+int32_t dot_product_int32( const std::vector<int32_t>& a, const std::vector<int32_t>& b )
 {
     assert ( a.size() == b.size() );
     int32_t sum {};
     #pragma omp parallel for reduction(+:sum)
-    for (int i = 0; i < a.size(); ++i)
+    for (std::size_t i = 0; i < a.size(); ++i)
     {
         sum += a[i] * b[i];
     }
     return sum;
 }
 
-void fill_w_rand( std::vector<int32_t>& arr, std::size_t size )
+/// @brief Пропускная способность в ГБ/с (оба вектора читаются один раз)
+/// и относительная ошибка вещественных вариантов против long double
+void run_dot_benchmark()
 {
-    for ( int i = 0; i < size; ++i)
+    constexpr std::size_t size = std::size_t{ 1 } << 24;
+    constexpr int rounds = 10;
+    constexpr uint64_t seed = 42;
+
+    auto measure = [&]( const char* name, std::size_t bytes, auto&& fn )
+    {
+        auto result = fn();
+        auto start = std::chrono::steady_clock::now();
+        for ( int i = 0; i < rounds; ++i )
+        {
+            result = fn();
+        }
+        auto seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() / rounds;
+        std::cout << name << ": " << bytes / seconds / 1e9 << " GB/s";
+        return result;
+    };
+
+    auto ia = std::vector<int32_t>( size );
+    auto ib = std::vector<int32_t>( size );
+    custom::parallel_fill_uniform<int32_t>( ia.data(), size, -( 1 << 20 ), 1 << 20, seed, 0 );
+    custom::parallel_fill_uniform<int32_t>( ib.data(), size, -( 1 << 20 ), 1 << 20, seed, 1 );
+    int64_t exact = 0;
+    for ( std::size_t i = 0; i < size; ++i )
+    {
+        exact += int64_t{ ia[ i ] } * ib[ i ];
+    }
+    auto legacy = measure( "int32, old reduction(+)", 2 * size * sizeof( int32_t ), [&] { return dot_product_int32( ia, ib ); } );
+    std::cout << ", " << ( legacy == exact ? "exact" : "overflowed" ) << std::endl;
+    auto widened = measure( "int32 -> int64", 2 * size * sizeof( int32_t ), [&] { return dot_product( ia, ib ); } );
+    std::cout << ", " << ( widened == exact ? "exact" : "wrong" ) << std::endl;
+    auto threaded = measure( "int32 -> int64, std::thread backend", 2 * size * sizeof( int32_t ), [&]
+    {
+        return dot::product( ia, ib, dot::summation::naive, { custom::reduce_backend::threads } );
+    } );
+    std::cout << ", " << ( threaded == exact ? "exact" : "wrong" ) << std::endl;
+
+    auto da = std::vector<double>( size );
+    auto db = std::vector<double>( size );
+    custom::parallel_fill_uniform( da.data(), size, -1.0, 1.0, seed, 2 );
+    custom::parallel_fill_uniform( db.data(), size, -1.0 + 1e-3, 1.0 + 1e-3, seed, 3 );
+    auto fa = std::vector<float>( da.begin(), da.end() );
+    auto fb = std::vector<float>( db.begin(), db.end() );
+
+    auto reference = [&]( const auto& x, const auto& y )
+    {
+        long double sum = 0;
+        for ( std::size_t i = 0; i < size; ++i )
+        {
+            sum += static_cast<long double>( x[ i ] ) * y[ i ];
+        }
+        return sum;
+    };
+    auto error = [&]( auto value, long double expected )
+    {
+        std::cout << ", relative error " << static_cast<double>( std::fabs( ( value - expected ) / expected ) ) << std::endl;
+    };
+    const auto float_ref = reference( fa, fb );
+    const auto double_ref = reference( da, db );
+    const std::pair<const char*, dot::summation> modes[] = {
+        { "naive", dot::summation::naive },
+        { "kahan", dot::summation::kahan },
+        { "pairwise", dot::summation::pairwise },
+    };
+    for ( auto [ name, mode ] : modes )
     {
-        arr.emplace_back( std::rand() % 10 );
+        auto label = std::string{ "float, " } + name;
+        error( measure( label.c_str(), 2 * size * sizeof( float ), [&] { return dot::product( fa, fb, mode ); } ), float_ref );
+        label = std::string{ "float -> double, " } + name;
+        error( measure( label.c_str(), 2 * size * sizeof( float ), [&] { return dot::product<float, double>( fa, fb, mode ); } ), float_ref );
+        label = std::string{ "double, " } + name;
+        error( measure( label.c_str(), 2 * size * sizeof( double ), [&] { return dot::product( da, db, mode ); } ), double_ref );
     }
 }
+#endif
 } // namespace
 
-int main()
+int main( int argc, char** argv )
 {
+#ifdef BENCHMARK
+    run_dot_benchmark();
+#endif
     int n;
     std::cout << "Enter size of vector" << std::endl;
     while ( !( std::cin >> n ) )
@@ -43,10 +337,11 @@ int main()
         std::cin.ignore( std::numeric_limits<std::streamsize>::max(), '\n' );
     }
 
+    const uint64_t seed = argc > 1 ? std::stoull( argv[ 1 ] ) : custom::philox4x32::default_seed;
     auto a = std::vector<int32_t>();
     auto b = std::vector<int32_t>();
-    fill_w_rand( a, n );
-    fill_w_rand( b, n );
+    fill_w_rand( a, n, seed, 0 );
+    fill_w_rand( b, n, seed, 1 );
     #ifdef DEBUG
         auto print = [] ( const std::vector<int32_t>& arr )
         {
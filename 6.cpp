@@ -5,29 +5,42 @@
 #include <chrono>
 #include <cassert>
 #include <functional>
+#include <string>
+#include <string_view>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <numeric>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstring>
 #include <omp.h>
 
+#include "random.hpp"
+
 namespace
 {
 
 using matrix_t = std::vector<std::vector<int32_t>>;
 
-void fill_matrix( matrix_t& matrix, uint16_t rows, uint16_t columns )
+/// @brief Заполняет матрицу значениями из [1, 10]
+/// Элемент (i, j) - значение номер i * columns + j потока stream, так что
+/// строки заполняются параллельно, а результат зависит только от seed.
+void fill_matrix( matrix_t& matrix, uint16_t rows, uint16_t columns, uint64_t seed, uint64_t stream )
 {
     assert( columns > 0 && rows > 0 );
 
     matrix.resize( rows );
-    std::random_device  rd;
-    std::uniform_int_distribution<int32_t> dist(1, 10);
-
-    std::for_each( matrix.begin(), matrix.end(), [&]( auto&& col )
+    std::for_each( matrix.begin(), matrix.end(), [&]( auto&& col ) { col.resize( columns ); } );
+    custom::for_each_block( rows, [&]( std::size_t begin, std::size_t end )
     {
-        col.resize( columns );
-        std::for_each( col.begin(), col.end(), [&]( auto& val )
+        for ( auto i = begin; i < end; ++i )
         {
-            val = dist(rd);
-        } );
-    } );
+            custom::fill_uniform< int32_t >( matrix[ i ].data(), columns, 1, 10, seed, uint64_t{ i } * columns, stream );
+        }
+    }, { custom::reduce_backend::openmp, false, 16 } );
 }
 
 void fill_matrix( matrix_t& matrix, int32_t to_fill,  uint16_t rows, uint16_t columns )
@@ -59,20 +72,26 @@ void print_matrix( const matrix_t& matrix )
 
 bool check_eq( const matrix_t& a, const matrix_t& b )
 {
-    assert( a.size() == b.size() );
-    for ( int i = 0; i < b.size() ; ++ i)
+    if ( a.size() != b.size() )
     {
-        for ( int j = 0; j < b.size(); ++ j)
+        return false;
+    }
+    for ( std::size_t i = 0; i < a.size(); ++i )
+    {
+        if ( a[ i ].size() != b[ i ].size() )
+        {
+            return false;
+        }
+        for ( std::size_t j = 0; j < a[ i ].size(); ++j )
         {
-            assert( a[j].size() == b[j].size() );
-            if ( a[i][j] != b[i][j] )
+            if ( a[ i ][ j ] != b[ i ][ j ] )
             {
                 return false;
             }
         }
     }
     return true;
-}   
+}
 
 matrix_t mult_matrix_no_threads( const matrix_t& a, const matrix_t& b )
 {
@@ -82,7 +101,6 @@ matrix_t mult_matrix_no_threads( const matrix_t& a, const matrix_t& b )
 
     auto result = matrix_t{};
     fill_matrix( result, 0, a.size(), ( * b.begin() ).size() );
-    std::cout << "No threads" << std::endl;
     for ( std::size_t i = 0; i < a.size(); ++i )
     {
         for ( std::size_t j = 0; j < ( * b.begin() ).size(); ++j )
@@ -96,7 +114,7 @@ matrix_t mult_matrix_no_threads( const matrix_t& a, const matrix_t& b )
     return result;
 }
 
-matrix_t mult_matrix( const matrix_t& a, const matrix_t& b )
+matrix_t mult_matrix_IJK( const matrix_t& a, const matrix_t& b )
 {
     auto a_columns = ( * a.begin() ).size();
     auto b_rows = b.size();
@@ -104,8 +122,8 @@ matrix_t mult_matrix( const matrix_t& a, const matrix_t& b )
 
     auto result = matrix_t{};
     fill_matrix( result, 0, a.size(), ( * b.begin() ).size() );
-    std::cout << "With threads" << std::endl;
-    #pragma omp parallel for num_threads(10)
+
+    #pragma omp parallel for schedule(runtime)
     for ( std::size_t i = 0; i < a.size(); ++i )
     {
         for ( std::size_t j = 0; j < ( * b.begin() ).size(); ++j )
@@ -120,7 +138,7 @@ matrix_t mult_matrix( const matrix_t& a, const matrix_t& b )
     return result;
 }
 
-matrix_t mult_matrix_IJK( const matrix_t& a, const matrix_t& b )
+matrix_t mult_matrix_JIK( const matrix_t& a, const matrix_t& b )
 {
     auto a_columns = ( * a.begin() ).size();
     auto b_rows = b.size();
@@ -129,14 +147,10 @@ matrix_t mult_matrix_IJK( const matrix_t& a, const matrix_t& b )
     auto result = matrix_t{};
     fill_matrix( result, 0, a.size(), ( * b.begin() ).size() );
 
-    std::cout << "With threads" << std::endl;
-    constexpr auto thread_num = 10;
-
-    #pragma omp parallel for num_threads(thread_num)
-
-    for ( std::size_t i = 0; i < a.size(); ++i )
+    #pragma omp parallel for schedule(runtime)
+    for ( std::size_t j = 0; j < ( * b.begin() ).size(); ++j )
     {
-        for ( std::size_t j = 0; j < ( * b.begin() ).size(); ++j )
+        for ( std::size_t i = 0; i < a.size(); ++i )
         {
             for ( std::size_t k = 0; k < ( * a.begin() ).size(); ++ k )
             {
@@ -148,74 +162,1412 @@ matrix_t mult_matrix_IJK( const matrix_t& a, const matrix_t& b )
     return result;
 }
 
-matrix_t mult_matrix_JIK( const matrix_t& a, const matrix_t& b )
+
+/// Плотная матрица в одном выровненном буфере, строки подряд.
+/// Длина строки в памяти (stride) дополнена до целой кэш-линии.
+template < typename T >
+class dense_matrix
 {
-    auto a_columns = ( * a.begin() ).size();
-    auto b_rows = b.size();
-    assert( a_columns == b_rows );
+    static_assert( std::is_arithmetic_v< T > );
 
-    auto result = matrix_t{};
-    fill_matrix( result, 0, a.size(), ( * b.begin() ).size() );
+    struct aligned_delete
+    {
+        void operator()( T* ptr ) const { ::operator delete[]( ptr, std::align_val_t{ alignment } ); }
+    };
 
-    std::cout << "With threads" << std::endl;
-    constexpr auto thread_num = 10;
+public:
+    static constexpr std::size_t alignment = 64;
 
-    #pragma omp parallel for num_threads(thread_num)
+    dense_matrix() = default;
 
-    for ( std::size_t j = 0; j < ( * b.begin() ).size(); ++j )
+    dense_matrix( std::size_t rows, std::size_t columns, T to_fill = T{} )
+        : rows_( rows )
+        , columns_( columns )
+        , stride_( ( columns + lane - 1 ) / lane * lane )
+        , data_( allocate( rows_ * stride_ ) )
     {
-        for ( std::size_t i = 0; i < a.size(); ++i )
+        std::fill_n( data_.get(), rows_ * stride_, to_fill );
+    }
+
+    explicit dense_matrix( const matrix_t& matrix )
+        : dense_matrix( matrix.size(), matrix.empty() ? 0 : matrix.front().size() )
+    {
+        for ( std::size_t i = 0; i < rows_; ++i )
         {
-            for ( std::size_t k = 0; k < ( * a.begin() ).size(); ++ k )
+            std::copy( matrix[ i ].begin(), matrix[ i ].end(), row( i ) );
+        }
+    }
+
+    dense_matrix( dense_matrix&& ) noexcept = default;
+    dense_matrix& operator=( dense_matrix&& ) noexcept = default;
+
+    std::size_t rows() const { return rows_; }
+    std::size_t columns() const { return columns_; }
+    std::size_t stride() const { return stride_; }
+
+    T* row( std::size_t i ) { return data_.get() + i * stride_; }
+    const T* row( std::size_t i ) const { return data_.get() + i * stride_; }
+
+    T& operator()( std::size_t i, std::size_t j ) { return row( i )[ j ]; }
+    const T& operator()( std::size_t i, std::size_t j ) const { return row( i )[ j ]; }
+
+    matrix_t to_matrix() const
+    {
+        auto ret = matrix_t( rows_ );
+        for ( std::size_t i = 0; i < rows_; ++i )
+        {
+            ret[ i ].assign( row( i ), row( i ) + columns_ );
+        }
+        return ret;
+    }
+
+private:
+    static constexpr std::size_t lane = alignment / sizeof( T );
+
+    static std::unique_ptr< T[], aligned_delete > allocate( std::size_t count )
+    {
+        auto* raw = static_cast< T* >( ::operator new[]( std::max<std::size_t>( count, 1 ) * sizeof( T ), std::align_val_t{ alignment } ) );
+        return std::unique_ptr< T[], aligned_delete >( raw );
+    }
+
+private:
+    std::size_t rows_ = 0;
+    std::size_t columns_ = 0;
+    std::size_t stride_ = 0;
+    std::unique_ptr< T[], aligned_delete > data_;
+};
+
+/// Размеры блоков: панель B (kc x nc) держится в L2, полоса строк C
+/// шириной nc - в L1, блок A (mc x kc) переиспользуется для всей панели.
+struct block_sizes
+{
+    std::size_t mc = 64;
+    std::size_t kc = 256;
+    std::size_t nc = 256;
+};
+
+/// @brief Блочное умножение с упаковкой панелей B и порядком i-k-j
+/// Для каждой пары (jc, pc) панель B копируется в непрерывный буфер,
+/// затем блоки строк A обрабатываются параллельно. Внутренний цикл идёт
+/// по строке упакованной панели и строке C подряд и векторизуется.
+template < typename T >
+dense_matrix< T > mult_blocked( const dense_matrix< T >& a, const dense_matrix< T >& b, block_sizes blocks = {} )
+{
+    assert( a.columns() == b.rows() );
+    const auto m = a.rows();
+    const auto n = b.columns();
+    const auto depth = a.columns();
+
+    auto result = dense_matrix< T >( m, n );
+    auto panel = dense_matrix< T >( blocks.kc, blocks.nc );
+
+    for ( std::size_t jc = 0; jc < n; jc += blocks.nc )
+    {
+        const auto nc = std::min( blocks.nc, n - jc );
+        for ( std::size_t pc = 0; pc < depth; pc += blocks.kc )
+        {
+            const auto kc = std::min( blocks.kc, depth - pc );
+
+            #pragma omp parallel
             {
-                result[i][j] += a[i][k] * b[k][j];
+                #pragma omp for schedule(static)
+                for ( std::size_t k = 0; k < kc; ++k )
+                {
+                    std::copy_n( b.row( pc + k ) + jc, nc, panel.row( k ) );
+                }
+
+                #pragma omp for schedule(dynamic)
+                for ( std::size_t ic = 0; ic < m; ic += blocks.mc )
+                {
+                    const auto mc = std::min( blocks.mc, m - ic );
+                    for ( std::size_t i = ic; i < ic + mc; ++i )
+                    {
+                        T* __restrict c_row = result.row( i ) + jc;
+                        const T* a_row = a.row( i ) + pc;
+                        for ( std::size_t k = 0; k < kc; ++k )
+                        {
+                            const T a_ik = a_row[ k ];
+                            const T* __restrict b_row = panel.row( k );
+                            #pragma omp simd
+                            for ( std::size_t j = 0; j < nc; ++j )
+                            {
+                                c_row[ j ] += a_ik * b_row[ j ];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/// Микроядра: блок C размером mr x nr держится в регистрах, на каждом k
+/// к нему прибавляется внешнее произведение столбца упакованной панели A
+/// (mr элементов) и строки упакованной панели B (nr элементов).
+namespace kernels
+{
+
+template < typename T >
+using kernel_fn = void ( * )( std::size_t kc, const T* a_panel, const T* b_panel, T* c, std::size_t ldc,
+    std::size_t rows, std::size_t columns );
+
+template < typename T >
+struct kernel_desc
+{
+    const char* name;
+    std::size_t mr;
+    std::size_t nr;
+    kernel_fn< T > fn;
+};
+
+/// Векторное тело ядра для регистра шириной Bytes: nr = 2 вектора
+template < typename T, std::size_t MR, std::size_t Bytes >
+[[gnu::always_inline]] inline void vector_body( std::size_t kc, const T* a_panel, const T* b_panel, T* c,
+    std::size_t ldc, std::size_t rows, std::size_t columns )
+{
+    typedef T vec __attribute__(( vector_size( Bytes ), aligned( alignof( T ) ) ));
+    constexpr std::size_t lanes = Bytes / sizeof( T );
+    constexpr std::size_t NR = 2 * lanes;
+
+    vec acc[ MR ][ 2 ] = {};
+    for ( std::size_t k = 0; k < kc; ++k )
+    {
+        vec b0, b1;
+        std::memcpy( &b0, b_panel + k * NR, Bytes );
+        std::memcpy( &b1, b_panel + k * NR + lanes, Bytes );
+        const T* a = a_panel + k * MR;
+        for ( std::size_t i = 0; i < MR; ++i )
+        {
+            const vec a_i = vec{} + a[ i ];
+            acc[ i ][ 0 ] += a_i * b0;
+            acc[ i ][ 1 ] += a_i * b1;
+        }
+    }
+
+    if ( rows == MR && columns == NR )
+    {
+        for ( std::size_t i = 0; i < MR; ++i )
+        {
+            vec c0, c1;
+            std::memcpy( &c0, c + i * ldc, Bytes );
+            std::memcpy( &c1, c + i * ldc + lanes, Bytes );
+            c0 += acc[ i ][ 0 ];
+            c1 += acc[ i ][ 1 ];
+            std::memcpy( c + i * ldc, &c0, Bytes );
+            std::memcpy( c + i * ldc + lanes, &c1, Bytes );
+        }
+        return;
+    }
+
+    T tail[ MR ][ NR ];
+    std::memcpy( tail, acc, sizeof( tail ) );
+    for ( std::size_t i = 0; i < rows; ++i )
+    {
+        for ( std::size_t j = 0; j < columns; ++j )
+        {
+            c[ i * ldc + j ] += tail[ i ][ j ];
+        }
+    }
+}
+
+/// Переносимое скалярное ядро 4x4
+template < typename T >
+void scalar_kernel( std::size_t kc, const T* a_panel, const T* b_panel, T* c, std::size_t ldc,
+    std::size_t rows, std::size_t columns )
+{
+    constexpr std::size_t MR = 4, NR = 4;
+    T acc[ MR ][ NR ] = {};
+    for ( std::size_t k = 0; k < kc; ++k )
+    {
+        for ( std::size_t i = 0; i < MR; ++i )
+        {
+            for ( std::size_t j = 0; j < NR; ++j )
+            {
+                acc[ i ][ j ] += a_panel[ k * MR + i ] * b_panel[ k * NR + j ];
+            }
+        }
+    }
+    for ( std::size_t i = 0; i < rows; ++i )
+    {
+        for ( std::size_t j = 0; j < columns; ++j )
+        {
+            c[ i * ldc + j ] += acc[ i ][ j ];
+        }
+    }
+}
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+
+/// 6 x (2 * 8 float | 2 * 8 int32 | 2 * 4 double): 12 аккумуляторов из 16 ymm
+template < typename T >
+__attribute__(( target( "avx2,fma" ) ))
+void avx2_kernel( std::size_t kc, const T* a_panel, const T* b_panel, T* c, std::size_t ldc,
+    std::size_t rows, std::size_t columns )
+{
+    vector_body< T, 6, 32 >( kc, a_panel, b_panel, c, ldc, rows, columns );
+}
+
+/// 14 x (2 * 16 float | 2 * 16 int32 | 2 * 8 double): 28 аккумуляторов из 32 zmm
+template < typename T >
+__attribute__(( target( "avx512f,fma" ) ))
+void avx512_kernel( std::size_t kc, const T* a_panel, const T* b_panel, T* c, std::size_t ldc,
+    std::size_t rows, std::size_t columns )
+{
+    vector_body< T, 14, 64 >( kc, a_panel, b_panel, c, ldc, rows, columns );
+}
+
+#endif
+
+template < typename T >
+kernel_desc< T > scalar()
+{
+    return { "scalar", 4, 4, scalar_kernel< T > };
+}
+
+/// @return Лучшее ядро для процессора, определяется через CPUID
+template < typename T >
+kernel_desc< T > select()
+{
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) )
+    {
+        return { "avx512", 14, 2 * 64 / sizeof( T ), avx512_kernel< T > };
+    }
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+    {
+        return { "avx2", 6, 2 * 32 / sizeof( T ), avx2_kernel< T > };
+    }
+#endif
+    return scalar< T >();
+}
+
+/// @return Все ядра, которые может выполнить процессор
+template < typename T >
+std::vector< kernel_desc< T > > available()
+{
+    auto ret = std::vector< kernel_desc< T > >{ scalar< T >() };
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+    {
+        ret.push_back( { "avx2", 6, 2 * 32 / sizeof( T ), avx2_kernel< T > } );
+    }
+    if ( __builtin_cpu_supports( "avx512f" ) )
+    {
+        ret.push_back( { "avx512", 14, 2 * 64 / sizeof( T ), avx512_kernel< T > } );
+    }
+#endif
+    return ret;
+}
+
+template < typename T >
+const kernel_desc< T >& best()
+{
+    static const auto desc = select< T >();
+    return desc;
+}
+
+} // namespace kernels
+
+/// @return Буфер упаковки текущего потока не короче size.
+/// Живёт между вызовами gemm_micro, так что панели не выделяются заново.
+template < typename T, char panel >
+T* pack_buffer( std::size_t size )
+{
+    thread_local auto buffer = std::vector< T >{};
+    if ( buffer.size() < size )
+    {
+        buffer.resize( size );
+    }
+    return buffer.data();
+}
+
+/// @brief C += A * B на микроядрах в схеме GotoBLAS
+/// Матрицы заданы указателем на первый элемент и длиной строки в памяти.
+/// Панель B (kc x nc) упаковывается полосами по nr столбцов, блок A
+/// (mc x kc) - полосами по mr строк; неполные полосы дополняются нулями,
+/// так что ядро всегда считает полный блок. Блоки строк идут параллельно.
+template < typename T >
+void gemm_micro( std::size_t m, std::size_t n, std::size_t depth,
+    const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc,
+    const kernels::kernel_desc< T >& kernel = kernels::best< T >() )
+{
+    const auto mr = kernel.mr;
+    const auto nr = kernel.nr;
+    const std::size_t kc_max = 256;
+    const std::size_t mc_max = mr * ( 192 / mr );
+    const std::size_t nc_max = nr * ( 2048 / nr );
+
+    // Панель B общая для команды: берём буфер вызывающего потока до parallel
+    T* const b_pack = pack_buffer< T, 'b' >( kc_max * nc_max );
+
+    for ( std::size_t jc = 0; jc < n; jc += nc_max )
+    {
+        const auto nc = std::min( nc_max, n - jc );
+        for ( std::size_t pc = 0; pc < depth; pc += kc_max )
+        {
+            const auto kc = std::min( kc_max, depth - pc );
+
+            #pragma omp parallel
+            {
+                #pragma omp for schedule(static)
+                for ( std::size_t jr = 0; jr < nc; jr += nr )
+                {
+                    T* dst = b_pack + jr * kc;
+                    const auto columns = std::min( nr, nc - jr );
+                    for ( std::size_t k = 0; k < kc; ++k, dst += nr )
+                    {
+                        const T* src = b + ( pc + k ) * ldb + jc + jr;
+                        std::copy_n( src, columns, dst );
+                        std::fill( dst + columns, dst + nr, T{} );
+                    }
+                }
+
+                T* const a_pack = pack_buffer< T, 'a' >( mc_max * kc );
+                #pragma omp for schedule(dynamic)
+                for ( std::size_t ic = 0; ic < m; ic += mc_max )
+                {
+                    const auto mc = std::min( mc_max, m - ic );
+                    for ( std::size_t ir = 0; ir < mc; ir += mr )
+                    {
+                        T* dst = a_pack + ir * kc;
+                        const auto rows = std::min( mr, mc - ir );
+                        for ( std::size_t k = 0; k < kc; ++k, dst += mr )
+                        {
+                            for ( std::size_t i = 0; i < rows; ++i )
+                            {
+                                dst[ i ] = a[ ( ic + ir + i ) * lda + pc + k ];
+                            }
+                            std::fill( dst + rows, dst + mr, T{} );
+                        }
+                    }
+
+                    for ( std::size_t jr = 0; jr < nc; jr += nr )
+                    {
+                        for ( std::size_t ir = 0; ir < mc; ir += mr )
+                        {
+                            kernel.fn( kc, a_pack + ir * kc, b_pack + jr * kc,
+                                c + ( ic + ir ) * ldc + jc + jr, ldc,
+                                std::min( mr, mc - ir ), std::min( nr, nc - jr ) );
+                        }
+                    }
+                }
             }
         }
     }
+}
 
+template < typename T >
+dense_matrix< T > mult_micro( const dense_matrix< T >& a, const dense_matrix< T >& b,
+    const kernels::kernel_desc< T >& kernel = kernels::best< T >() )
+{
+    assert( a.columns() == b.rows() );
+    auto result = dense_matrix< T >( a.rows(), b.columns() );
+    gemm_micro( a.rows(), b.columns(), a.columns(), a.row( 0 ), a.stride(), b.row( 0 ), b.stride(),
+        result.row( 0 ), result.stride(), kernel );
     return result;
 }
 
-} // namespace
+/// Параметры рекурсивного умножения
+struct recursion_params
+{
+    /// Подзадачи, у которых все размеры не больше cutoff, считает gemm_micro
+    std::size_t cutoff = 256;
+    /// Сколько верхних уровней рекурсии выполнять по Штрассену-Винограду
+    int strassen_levels = 0;
+};
 
-int main() try
-{
-    std::cout << "Running a program" << std::endl;
-    auto first_matrix = matrix_t{};
-    auto second_matrix = matrix_t{};
-    fill_matrix( first_matrix, 1000, 1000 );
-    #ifdef DEBUG
-    print_matrix( first_matrix );
-    std::cout << "----------" << std::endl;
-    #endif
-    fill_matrix( second_matrix, 1000, 1000 );
-    #ifdef DEBUG
-    print_matrix( second_matrix );
-    std::cout << "----------" << std::endl;
-    #endif
-    auto time_count = [] ( const std::function< matrix_t(const matrix_t&, const matrix_t &) >& action,
-        const matrix_t& a, const matrix_t& b )
+template < typename T >
+void gemm_recursive( std::size_t m, std::size_t n, std::size_t depth,
+    const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc,
+    recursion_params params );
+
+/// @brief Один уровень Штрассена-Винограда: 7 умножений половинного
+/// размера вместо 8 ценой 15 сложений. Все размеры должны быть чётными.
+template < typename T >
+void gemm_strassen_winograd( std::size_t m, std::size_t n, std::size_t depth,
+    const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc,
+    recursion_params params )
+{
+    const auto hm = m / 2, hn = n / 2, hk = depth / 2;
+    const T* a11 = a;
+    const T* a12 = a + hk;
+    const T* a21 = a + hm * lda;
+    const T* a22 = a21 + hk;
+    const T* b11 = b;
+    const T* b12 = b + hn;
+    const T* b21 = b + hk * ldb;
+    const T* b22 = b21 + hn;
+
+    auto s1 = dense_matrix< T >( hm, hk ), s2 = dense_matrix< T >( hm, hk );
+    auto s3 = dense_matrix< T >( hm, hk ), s4 = dense_matrix< T >( hm, hk );
+    for ( std::size_t i = 0; i < hm; ++i )
+    {
+        for ( std::size_t k = 0; k < hk; ++k )
+        {
+            s1( i, k ) = a21[ i * lda + k ] + a22[ i * lda + k ];
+            s2( i, k ) = s1( i, k ) - a11[ i * lda + k ];
+            s3( i, k ) = a11[ i * lda + k ] - a21[ i * lda + k ];
+            s4( i, k ) = a12[ i * lda + k ] - s2( i, k );
+        }
+    }
+    auto t1 = dense_matrix< T >( hk, hn ), t2 = dense_matrix< T >( hk, hn );
+    auto t3 = dense_matrix< T >( hk, hn ), t4 = dense_matrix< T >( hk, hn );
+    for ( std::size_t k = 0; k < hk; ++k )
+    {
+        for ( std::size_t j = 0; j < hn; ++j )
+        {
+            t1( k, j ) = b12[ k * ldb + j ] - b11[ k * ldb + j ];
+            t2( k, j ) = b22[ k * ldb + j ] - t1( k, j );
+            t3( k, j ) = b22[ k * ldb + j ] - b12[ k * ldb + j ];
+            t4( k, j ) = t2( k, j ) - b21[ k * ldb + j ];
+        }
+    }
+
+    auto p = std::vector< dense_matrix< T > >{};
+    for ( int i = 0; i < 7; ++i )
+    {
+        p.emplace_back( hm, hn );
+    }
+    --params.strassen_levels;
+    auto product = [ & ]( std::size_t index, const T* x, std::size_t ldx, const T* y, std::size_t ldy )
+    {
+        auto* out = &p[ index ];
+        #pragma omp task firstprivate( x, ldx, y, ldy, out, params ) shared( hm, hn, hk )
+        gemm_recursive( hm, hn, hk, x, ldx, y, ldy, out->row( 0 ), out->stride(), params );
+    };
+    product( 0, a11, lda, b11, ldb );
+    product( 1, a12, lda, b21, ldb );
+    product( 2, s4.row( 0 ), s4.stride(), b22, ldb );
+    product( 3, a22, lda, t4.row( 0 ), t4.stride() );
+    product( 4, s1.row( 0 ), s1.stride(), t1.row( 0 ), t1.stride() );
+    product( 5, s2.row( 0 ), s2.stride(), t2.row( 0 ), t2.stride() );
+    product( 6, s3.row( 0 ), s3.stride(), t3.row( 0 ), t3.stride() );
+    #pragma omp taskwait
+
+    for ( std::size_t i = 0; i < hm; ++i )
+    {
+        T* c11 = c + i * ldc;
+        T* c12 = c11 + hn;
+        T* c21 = c + ( hm + i ) * ldc;
+        T* c22 = c21 + hn;
+        for ( std::size_t j = 0; j < hn; ++j )
+        {
+            const T u2 = p[ 0 ]( i, j ) + p[ 5 ]( i, j );
+            const T u3 = u2 + p[ 6 ]( i, j );
+            c11[ j ] += p[ 0 ]( i, j ) + p[ 1 ]( i, j );
+            c12[ j ] += u2 + p[ 4 ]( i, j ) + p[ 2 ]( i, j );
+            c21[ j ] += u3 - p[ 3 ]( i, j );
+            c22[ j ] += u3 + p[ 4 ]( i, j );
+        }
+    }
+}
+
+/// @brief C += A * B делением пополам наибольшего размера
+/// Половины по строкам A и столбцам B независимы и идут задачами OpenMP,
+/// половины по общему размеру складываются в C по очереди.
+template < typename T >
+void gemm_recursive( std::size_t m, std::size_t n, std::size_t depth,
+    const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc,
+    recursion_params params )
+{
+    if ( std::max( { m, n, depth } ) <= params.cutoff )
+    {
+        gemm_micro( m, n, depth, a, lda, b, ldb, c, ldc );
+        return;
+    }
+    if ( params.strassen_levels > 0 && m % 2 == 0 && n % 2 == 0 && depth % 2 == 0 )
+    {
+        gemm_strassen_winograd( m, n, depth, a, lda, b, ldb, c, ldc, params );
+        return;
+    }
+
+    if ( m >= n && m >= depth )
+    {
+        const auto half = m / 2;
+        #pragma omp task firstprivate( half, n, depth, a, lda, b, ldb, c, ldc, params )
+        gemm_recursive( half, n, depth, a, lda, b, ldb, c, ldc, params );
+        gemm_recursive( m - half, n, depth, a + half * lda, lda, b, ldb, c + half * ldc, ldc, params );
+        #pragma omp taskwait
+    }
+    else if ( n >= depth )
+    {
+        const auto half = n / 2;
+        #pragma omp task firstprivate( half, m, depth, a, lda, b, ldb, c, ldc, params )
+        gemm_recursive( m, half, depth, a, lda, b, ldb, c, ldc, params );
+        gemm_recursive( m, n - half, depth, a, lda, b + half, ldb, c + half, ldc, params );
+        #pragma omp taskwait
+    }
+    else
+    {
+        const auto half = depth / 2;
+        gemm_recursive( m, n, half, a, lda, b, ldb, c, ldc, params );
+        gemm_recursive( m, n, depth - half, a + half, lda, b + half * ldb, ldb, c, ldc, params );
+    }
+}
+
+template < typename T >
+dense_matrix< T > mult_recursive( const dense_matrix< T >& a, const dense_matrix< T >& b, recursion_params params = {} )
+{
+    assert( a.columns() == b.rows() );
+    auto result = dense_matrix< T >( a.rows(), b.columns() );
+    #pragma omp parallel
+    #pragma omp single
+    gemm_recursive( a.rows(), b.columns(), a.columns(), a.row( 0 ), a.stride(), b.row( 0 ), b.stride(),
+        result.row( 0 ), result.stride(), params );
+    return result;
+}
+
+/// Разреженные матрицы. Хранение общее для CSR и CSC: элементы «главной»
+/// линии i (строки для CSR, столбца для CSC) лежат в values[ offsets[ i ]
+/// .. offsets[ i + 1 ] ), их номера по второму измерению - в indices,
+/// по возрастанию. CSC матрицы X устроено так же, как CSR матрицы X^T.
+namespace sparse
+{
+
+template < typename T >
+struct compressed
+{
+    compressed() = default;
+
+    /// @brief Пустая матрица major x minor без ненулевых элементов
+    compressed( std::size_t major, std::size_t minor )
+        : major( major )
+        , minor( minor )
+    {
+    }
+
+    std::size_t major = 0;
+    std::size_t minor = 0;
+    std::vector< std::size_t > offsets{ 0 };
+    std::vector< uint32_t > indices;
+    std::vector< T > values;
+
+    std::size_t nnz() const { return values.size(); }
+};
+
+/// @brief Сжимает ненулевые элементы, element( i, j ) - j-й элемент
+/// i-й главной линии
+template < typename T, typename Element >
+compressed< T > compress( std::size_t major, std::size_t minor, Element element )
+{
+    auto ret = compressed< T >( major, minor );
+    ret.offsets.reserve( major + 1 );
+    for ( std::size_t i = 0; i < major; ++i )
+    {
+        for ( std::size_t j = 0; j < minor; ++j )
+        {
+            if ( const auto value = element( i, j ); value != 0 )
+            {
+                ret.indices.push_back( static_cast< uint32_t >( j ) );
+                ret.values.push_back( static_cast< T >( value ) );
+            }
+        }
+        ret.offsets.push_back( ret.values.size() );
+    }
+    return ret;
+}
+
+/// @brief Произведение по Густавсону: строка i результата собирается
+/// из строк B, выбранных ненулями строки i матрицы A
+/// Символический проход заранее считает точное число элементов в каждой
+/// строке, поэтому результат выделяется один раз. В численном проходе
+/// у каждого потока свой плотный аккумулятор длиной minor с маркерами.
+template < typename T >
+compressed< T > gustavson( const compressed< T >& a, const compressed< T >& b )
+{
+    assert( a.minor == b.major );
+    constexpr auto unmarked = std::numeric_limits< std::size_t >::max();
+
+    auto ret = compressed< T >( a.major, b.minor );
+    ret.offsets.assign( a.major + 1, 0 );
+
+    #pragma omp parallel
+    {
+        auto marker = std::vector< std::size_t >( b.minor, unmarked );
+        #pragma omp for schedule(guided)
+        for ( std::size_t i = 0; i < a.major; ++i )
+        {
+            std::size_t count = 0;
+            for ( auto p = a.offsets[ i ]; p < a.offsets[ i + 1 ]; ++p )
+            {
+                const auto k = a.indices[ p ];
+                for ( auto q = b.offsets[ k ]; q < b.offsets[ k + 1 ]; ++q )
+                {
+                    const auto j = b.indices[ q ];
+                    if ( marker[ j ] != i )
+                    {
+                        marker[ j ] = i;
+                        ++count;
+                    }
+                }
+            }
+            ret.offsets[ i + 1 ] = count;
+        }
+    }
+    std::partial_sum( ret.offsets.begin(), ret.offsets.end(), ret.offsets.begin() );
+    ret.indices.resize( ret.offsets.back() );
+    ret.values.resize( ret.offsets.back() );
+
+    #pragma omp parallel
+    {
+        auto accumulator = std::vector< T >( b.minor );
+        auto marker = std::vector< std::size_t >( b.minor, unmarked );
+        auto touched = std::vector< uint32_t >{};
+        touched.reserve( b.minor );
+        #pragma omp for schedule(guided)
+        for ( std::size_t i = 0; i < a.major; ++i )
+        {
+            touched.clear();
+            for ( auto p = a.offsets[ i ]; p < a.offsets[ i + 1 ]; ++p )
+            {
+                const auto k = a.indices[ p ];
+                const auto a_ik = a.values[ p ];
+                for ( auto q = b.offsets[ k ]; q < b.offsets[ k + 1 ]; ++q )
+                {
+                    const auto j = b.indices[ q ];
+                    if ( marker[ j ] != i )
+                    {
+                        marker[ j ] = i;
+                        accumulator[ j ] = a_ik * b.values[ q ];
+                        touched.push_back( j );
+                    }
+                    else
+                    {
+                        accumulator[ j ] += a_ik * b.values[ q ];
+                    }
+                }
+            }
+            std::sort( touched.begin(), touched.end() );
+            auto out = ret.offsets[ i ];
+            for ( auto j : touched )
+            {
+                ret.indices[ out ] = j;
+                ret.values[ out ] = accumulator[ j ];
+                ++out;
+            }
+        }
+    }
+    return ret;
+}
+
+/// @return Число умножений в произведении a * b
+template < typename T >
+std::size_t product_flops( const compressed< T >& a, const compressed< T >& b )
+{
+    std::size_t flops = 0;
+    for ( auto k : a.indices )
+    {
+        flops += b.offsets[ k + 1 ] - b.offsets[ k ];
+    }
+    return flops;
+}
+
+} // namespace sparse
+
+/// Разреженная матрица по строкам
+template < typename T >
+class csr_matrix
+{
+public:
+    csr_matrix() = default;
+
+    explicit csr_matrix( const matrix_t& matrix )
+        : data_( sparse::compress< T >( matrix.size(), matrix.empty() ? 0 : matrix.front().size(),
+            [ & ]( std::size_t i, std::size_t j ) { return matrix[ i ][ j ]; } ) )
+    {
+    }
+
+    explicit csr_matrix( sparse::compressed< T >&& data ) : data_( std::move( data ) ) {}
+
+    std::size_t rows() const { return data_.major; }
+    std::size_t columns() const { return data_.minor; }
+    std::size_t nnz() const { return data_.nnz(); }
+    const sparse::compressed< T >& data() const { return data_; }
+
+    matrix_t to_matrix() const
+    {
+        auto ret = matrix_t( rows(), std::vector< int32_t >( columns() ) );
+        for ( std::size_t i = 0; i < rows(); ++i )
+        {
+            for ( auto p = data_.offsets[ i ]; p < data_.offsets[ i + 1 ]; ++p )
+            {
+                ret[ i ][ data_.indices[ p ] ] = static_cast< int32_t >( data_.values[ p ] );
+            }
+        }
+        return ret;
+    }
+
+private:
+    sparse::compressed< T > data_;
+};
+
+/// Разреженная матрица по столбцам
+template < typename T >
+class csc_matrix
+{
+public:
+    csc_matrix() = default;
+
+    explicit csc_matrix( const matrix_t& matrix )
+        : data_( sparse::compress< T >( matrix.empty() ? 0 : matrix.front().size(), matrix.size(),
+            [ & ]( std::size_t j, std::size_t i ) { return matrix[ i ][ j ]; } ) )
+    {
+    }
+
+    explicit csc_matrix( sparse::compressed< T >&& data ) : data_( std::move( data ) ) {}
+
+    std::size_t rows() const { return data_.minor; }
+    std::size_t columns() const { return data_.major; }
+    std::size_t nnz() const { return data_.nnz(); }
+    const sparse::compressed< T >& data() const { return data_; }
+
+    matrix_t to_matrix() const
+    {
+        auto ret = matrix_t( rows(), std::vector< int32_t >( columns() ) );
+        for ( std::size_t j = 0; j < columns(); ++j )
+        {
+            for ( auto p = data_.offsets[ j ]; p < data_.offsets[ j + 1 ]; ++p )
+            {
+                ret[ data_.indices[ p ] ][ j ] = static_cast< int32_t >( data_.values[ p ] );
+            }
+        }
+        return ret;
+    }
+
+private:
+    sparse::compressed< T > data_;
+};
+
+/// @brief y = A * x, строки параллельно
+template < typename T >
+void spmv( const csr_matrix< T >& a, const T* x, T* y )
+{
+    const auto& d = a.data();
+    #pragma omp parallel for schedule(guided)
+    for ( std::size_t i = 0; i < d.major; ++i )
+    {
+        T sum{};
+        for ( auto p = d.offsets[ i ]; p < d.offsets[ i + 1 ]; ++p )
+        {
+            sum += d.values[ p ] * x[ d.indices[ p ] ];
+        }
+        y[ i ] = sum;
+    }
+}
+
+/// @brief y = A * x для CSC: столбцы раздаются потокам, каждый копит
+/// свой вектор y, затем векторы складываются по строкам
+template < typename T >
+void spmv( const csc_matrix< T >& a, const T* x, T* y )
+{
+    const auto& d = a.data();
+    const auto rows = d.minor;
+    auto partial = std::vector< T >( static_cast< std::size_t >( omp_get_max_threads() ) * rows );
+    #pragma omp parallel
+    {
+        T* local = partial.data() + static_cast< std::size_t >( omp_get_thread_num() ) * rows;
+        #pragma omp for schedule(guided)
+        for ( std::size_t j = 0; j < d.major; ++j )
+        {
+            const auto x_j = x[ j ];
+            for ( auto p = d.offsets[ j ]; p < d.offsets[ j + 1 ]; ++p )
+            {
+                local[ d.indices[ p ] ] += d.values[ p ] * x_j;
+            }
+        }
+
+        const auto threads = partial.size() / std::max< std::size_t >( rows, 1 );
+        #pragma omp for schedule(static)
+        for ( std::size_t i = 0; i < rows; ++i )
+        {
+            T sum{};
+            for ( std::size_t t = 0; t < threads; ++t )
+            {
+                sum += partial[ t * rows + i ];
+            }
+            y[ i ] = sum;
+        }
+    }
+}
+
+template < typename T >
+csr_matrix< T > spgemm( const csr_matrix< T >& a, const csr_matrix< T >& b )
+{
+    assert( a.columns() == b.rows() );
+    return csr_matrix< T >( sparse::gustavson( a.data(), b.data() ) );
+}
+
+/// @brief Для CSC считается (A * B)^T = B^T * A^T тем же Густавсоном
+template < typename T >
+csc_matrix< T > spgemm( const csc_matrix< T >& a, const csc_matrix< T >& b )
+{
+    assert( a.columns() == b.rows() );
+    return csc_matrix< T >( sparse::gustavson( b.data(), a.data() ) );
+}
+
+/// Замеры: каждый вариант умножения прогоняется warmup раз вхолостую и
+/// repetitions раз под таймером; в отчёт идут медиана и 95-й перцентиль.
+namespace bench
+{
+
+/// Подготовленный запуск: входы уже сконвертированы, таймер видит только run
+struct prepared_run
+{
+    std::function< void() > run;
+    /// Результат последнего run для сверки с эталоном
+    std::function< matrix_t() > result;
+    /// Полезные арифметические операции за один run
+    double ops = 0;
+    /// Обязательный трафик за один run: входы и выход по разу
+    double bytes = 0;
+};
+
+struct variant
+{
+    std::string name;
+    std::string type;
+    /// Зависит ли вариант от omp schedule (циклы со schedule(runtime))
+    bool scheduled;
+    /// Наивные варианты на больших размерах не прогоняются
+    std::size_t max_size;
+    std::function< prepared_run( const matrix_t&, const matrix_t& ) > prepare;
+};
+
+struct config
+{
+    std::vector< std::size_t > sizes{ 1000 };
+    std::vector< int > threads{ omp_get_max_threads() };
+    std::vector< std::string > schedules{ "static", "dynamic", "guided" };
+    std::size_t warmup = 1;
+    std::size_t repetitions = 3;
+    /// Доля ненулевых элементов во входных матрицах
+    double density = 1.0;
+    uint64_t seed = custom::philox4x32::default_seed;
+    std::string format = "table";
+    /// Прогонять только варианты, в имени которых есть эта подстрока
+    std::string only;
+};
+
+struct record
+{
+    std::size_t size;
+    std::string name;
+    std::string type;
+    int threads;
+    std::string schedule;
+    double median_ms;
+    double p95_ms;
+    /// Миллиарды полезных операций в секунду (2 * n^3 для плотных)
+    double gops;
+    /// Обязательный трафик в ГБ/с - нижняя оценка
+    double gbps;
+    bool ok;
+    /// С чем сравнивался результат
+    std::string reference;
+};
+
+/// @brief Эталон для проверки результатов: наивное произведение
+/// До full_reference_size оно считается целиком; на больших размерах это
+/// слишком долго, и наивно считаются только строки из равномерной выборки,
+/// включающей первую и последнюю.
+struct reference
+{
+    static constexpr std::size_t full_reference_size = 1024;
+    static constexpr std::size_t sampled_rows = 64;
+
+    /// Номера строк произведения, для которых есть эталон
+    std::vector< std::size_t > rows;
+    /// Эталонные строки в порядке rows
+    matrix_t values;
+    std::size_t columns = 0;
+    bool sampled = false;
+
+    std::string name() const
+    {
+        return sampled ? "naive/" + std::to_string( rows.size() ) + "rows" : "naive";
+    }
+};
+
+reference make_reference( const matrix_t& a, const matrix_t& b )
+{
+    auto ret = reference{};
+    ret.columns = b.empty() ? 0 : b.front().size();
+    if ( a.size() <= reference::full_reference_size )
+    {
+        ret.values = mult_matrix_no_threads( a, b );
+        for ( std::size_t i = 0; i < a.size(); ++i )
+        {
+            ret.rows.push_back( i );
+        }
+        return ret;
+    }
+
+    ret.sampled = true;
+    const auto count = reference::sampled_rows;
+    for ( std::size_t r = 0; r < count; ++r )
+    {
+        ret.rows.push_back( r * ( a.size() - 1 ) / ( count - 1 ) );
+    }
+    ret.values.assign( count, std::vector< int32_t >( ret.columns, 0 ) );
+    #pragma omp parallel for
+    for ( std::size_t r = 0; r < count; ++r )
+    {
+        const auto& row = a[ ret.rows[ r ] ];
+        auto& out = ret.values[ r ];
+        for ( std::size_t k = 0; k < row.size(); ++k )
+        {
+            for ( std::size_t j = 0; j < ret.columns; ++j )
+            {
+                out[ j ] += row[ k ] * b[ k ][ j ];
+            }
+        }
+    }
+    return ret;
+}
+
+/// @return Совпадает ли result с эталоном на строках эталона
+bool check_reference( const reference& ref, const matrix_t& result )
+{
+    if ( !ref.sampled )
+    {
+        return check_eq( ref.values, result );
+    }
+    if ( result.empty() || result.size() <= ref.rows.back() )
+    {
+        return false;
+    }
+    for ( std::size_t r = 0; r < ref.rows.size(); ++r )
+    {
+        if ( result[ ref.rows[ r ] ] != ref.values[ r ] )
+        {
+            return false;
+        }
+    }
+    return std::all_of( result.begin(), result.end(), [ & ]( const auto& row ) { return row.size() == ref.columns; } );
+}
+
+/// @return Операции и трафик плотного умножения a * b с элементами типа T
+template < typename T >
+prepared_run dense_work( const matrix_t& a, const matrix_t& b, prepared_run prepared )
+{
+    const double m = a.size();
+    const double k = b.size();
+    const double n = b.empty() ? 0 : b.front().size();
+    prepared.ops = 2 * m * n * k;
+    prepared.bytes = ( m * k + k * n + m * n ) * sizeof( T );
+    return prepared;
+}
+
+template < typename Mult >
+prepared_run prepare_plain( const matrix_t& a, const matrix_t& b, Mult mult )
+{
+    struct state { matrix_t a, b, c; };
+    auto s = std::make_shared< state >( state{ a, b, {} } );
+    return dense_work< int32_t >( a, b, { [ s, mult ] { s->c = mult( s->a, s->b ); }, [ s ] { return s->c; } } );
+}
+
+template < typename T, typename Mult >
+prepared_run prepare_dense( const matrix_t& a, const matrix_t& b, Mult mult )
+{
+    struct state { dense_matrix< T > a, b, c; };
+    auto s = std::make_shared< state >( state{ dense_matrix< T >( a ), dense_matrix< T >( b ), {} } );
+    return dense_work< T >( a, b, { [ s, mult ] { s->c = mult( s->a, s->b ); }, [ s ]
+    {
+        auto ret = matrix_t( s->c.rows() );
+        for ( std::size_t i = 0; i < s->c.rows(); ++i )
+        {
+            ret[ i ].assign( s->c.row( i ), s->c.row( i ) + s->c.columns() );
+        }
+        return ret;
+    } } );
+}
+
+template < typename Sparse >
+double sparse_bytes( const Sparse& matrix )
+{
+    return matrix.nnz() * ( sizeof( matrix.data().values[ 0 ] ) + sizeof( uint32_t ) )
+        + matrix.data().offsets.size() * sizeof( std::size_t );
+}
+
+/// @brief SpMV по каждому столбцу B как отдельному вектору
+template < typename Sparse >
+prepared_run prepare_spmv( const matrix_t& a, const matrix_t& b )
+{
+    struct state { Sparse a; std::vector< std::vector< int32_t > > x, y; };
+    const auto n = b.empty() ? 0 : b.front().size();
+    auto s = std::make_shared< state >( state{ Sparse( a ), std::vector< std::vector< int32_t > >( n ),
+        std::vector< std::vector< int32_t > >( n, std::vector< int32_t >( a.size() ) ) } );
+    for ( std::size_t j = 0; j < n; ++j )
+    {
+        for ( auto&& row : b )
+        {
+            s->x[ j ].push_back( row[ j ] );
+        }
+    }
+    auto ret = prepared_run{ [ s ]
+    {
+        for ( std::size_t j = 0; j < s->x.size(); ++j )
+        {
+            spmv( s->a, s->x[ j ].data(), s->y[ j ].data() );
+        }
+    }, [ s ]
+    {
+        auto c = matrix_t( s->a.rows(), std::vector< int32_t >( s->y.size() ) );
+        for ( std::size_t j = 0; j < s->y.size(); ++j )
+        {
+            for ( std::size_t i = 0; i < s->a.rows(); ++i )
+            {
+                c[ i ][ j ] = s->y[ j ][ i ];
+            }
+        }
+        return c;
+    } };
+    ret.ops = 2.0 * s->a.nnz() * n;
+    ret.bytes = n * ( sparse_bytes( s->a ) + ( s->a.rows() + s->a.columns() ) * sizeof( int32_t ) );
+    return ret;
+}
+
+template < typename Sparse >
+prepared_run prepare_spgemm( const matrix_t& a, const matrix_t& b )
+{
+    struct state { Sparse a, b, c; };
+    auto s = std::make_shared< state >( state{ Sparse( a ), Sparse( b ), {} } );
+    auto ret = prepared_run{ [ s ] { s->c = spgemm( s->a, s->b ); }, [ s ] { return s->c.to_matrix(); } };
+    const auto product = spgemm( s->a, s->b );
+    const auto flops = std::is_same_v< Sparse, csr_matrix< int32_t > >
+        ? sparse::product_flops( s->a.data(), s->b.data() ) : sparse::product_flops( s->b.data(), s->a.data() );
+    ret.ops = 2.0 * flops;
+    ret.bytes = sparse_bytes( s->a ) + sparse_bytes( s->b ) + sparse_bytes( product );
+    return ret;
+}
+
+template < typename T >
+void add_dense_variants( std::vector< variant >& out, const std::string& type )
+{
+    constexpr auto max = std::numeric_limits< std::size_t >::max();
+    out.push_back( { "blocked", type, false, max, []( const matrix_t& a, const matrix_t& b )
+    {
+        return prepare_dense< T >( a, b, []( const auto& x, const auto& y ) { return mult_blocked( x, y ); } );
+    } } );
+    for ( auto&& kernel : kernels::available< T >() )
+    {
+        out.push_back( { "micro/" + std::string{ kernel.name }, type, false, max, [ kernel ]( const matrix_t& a, const matrix_t& b )
+        {
+            return prepare_dense< T >( a, b, [ kernel ]( const auto& x, const auto& y ) { return mult_micro( x, y, kernel ); } );
+        } } );
+    }
+    out.push_back( { "recursive", type, false, max, []( const matrix_t& a, const matrix_t& b )
+    {
+        return prepare_dense< T >( a, b, []( const auto& x, const auto& y ) { return mult_recursive( x, y ); } );
+    } } );
+    out.push_back( { "strassen", type, false, max, []( const matrix_t& a, const matrix_t& b )
+    {
+        return prepare_dense< T >( a, b, []( const auto& x, const auto& y ) { return mult_recursive( x, y, { 256, 2 } ); } );
+    } } );
+}
+
+std::vector< variant > all_variants()
+{
+    auto ret = std::vector< variant >{
+        { "no_threads", "int32", false, 1024, []( const matrix_t& a, const matrix_t& b ) { return prepare_plain( a, b, mult_matrix_no_threads ); } },
+        { "IJK", "int32", true, 2048, []( const matrix_t& a, const matrix_t& b ) { return prepare_plain( a, b, mult_matrix_IJK ); } },
+        { "JIK", "int32", true, 2048, []( const matrix_t& a, const matrix_t& b ) { return prepare_plain( a, b, mult_matrix_JIK ); } },
+    };
+    add_dense_variants< int32_t >( ret, "int32" );
+    // Произведения целых из [1, 10] точно представимы в float до n ~ 160000
+    add_dense_variants< float >( ret, "float" );
+    add_dense_variants< double >( ret, "double" );
+
+    constexpr auto max = std::numeric_limits< std::size_t >::max();
+    ret.push_back( { "csr_spmv", "int32", false, max, prepare_spmv< csr_matrix< int32_t > > } );
+    ret.push_back( { "csc_spmv", "int32", false, max, prepare_spmv< csc_matrix< int32_t > > } );
+    ret.push_back( { "csr_spgemm", "int32", false, max, prepare_spgemm< csr_matrix< int32_t > > } );
+    ret.push_back( { "csc_spgemm", "int32", false, max, prepare_spgemm< csc_matrix< int32_t > > } );
+    return ret;
+}
+
+void set_schedule( const std::string& name )
+{
+    if ( name == "static" )
+    {
+        omp_set_schedule( omp_sched_static, 0 );
+    }
+    else if ( name == "dynamic" )
+    {
+        omp_set_schedule( omp_sched_dynamic, 1 );
+    }
+    else if ( name == "guided" )
+    {
+        omp_set_schedule( omp_sched_guided, 1 );
+    }
+    else
+    {
+        throw std::invalid_argument( "Error: \"unknown schedule " + name + "\"" );
+    }
+}
+
+/// @brief Оставляет ненулевой примерно долю density элементов
+void sparsify( matrix_t& matrix, double density, uint64_t seed, uint64_t stream )
+{
+    if ( density >= 1.0 )
+    {
+        return;
+    }
+    auto keep = std::vector< double >{};
+    for ( std::size_t i = 0; i < matrix.size(); ++i )
+    {
+        keep.resize( matrix[ i ].size() );
+        custom::fill_uniform( keep.data(), keep.size(), 0.0, 1.0, seed, i * keep.size(), stream );
+        for ( std::size_t j = 0; j < keep.size(); ++j )
+        {
+            if ( keep[ j ] >= density )
+            {
+                matrix[ i ][ j ] = 0;
+            }
+        }
+    }
+}
+
+/// @return p-й перцентиль по ближайшему рангу
+double percentile( std::vector< double > samples, double p )
+{
+    std::sort( samples.begin(), samples.end() );
+    auto rank = static_cast< std::size_t >( std::ceil( p * samples.size() ) );
+    return samples[ std::clamp< std::size_t >( rank, 1, samples.size() ) - 1 ];
+}
+
+record measure( const variant& v, const prepared_run& prepared, std::size_t size, int threads,
+    const std::string& schedule, const reference& expected, const config& cfg )
+{
+    for ( std::size_t i = 0; i < cfg.warmup; ++i )
+    {
+        prepared.run();
+    }
+    auto samples = std::vector< double >{};
+    for ( std::size_t i = 0; i < cfg.repetitions; ++i )
     {
         auto start = std::chrono::steady_clock::now();
-        auto res = action( a, b );
+        prepared.run();
         auto end = std::chrono::steady_clock::now();
-        std::cout << "Elapsed time in milliseconds: "
-        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-        << " ms" << std::endl;
-        return res;
-    };
+        samples.push_back( std::chrono::duration< double, std::milli >( end - start ).count() );
+    }
+    const auto median = percentile( samples, 0.5 );
+    return { size, v.name, v.type, threads, schedule, median, percentile( samples, 0.95 ),
+        prepared.ops / median / 1e6, prepared.bytes / median / 1e6,
+        check_reference( expected, prepared.result() ), expected.name() };
+}
+
+void print_header( const config& cfg )
+{
+    if ( cfg.format == "csv" )
+    {
+        std::cout << "size,variant,type,threads,schedule,median_ms,p95_ms,gops,gbps,ok,reference" << std::endl;
+    }
+    else if ( cfg.format == "json" )
+    {
+        std::cout << "[" << std::endl;
+    }
+    else
+    {
+        std::cout << std::left << std::setw( 6 ) << "size" << std::setw( 16 ) << "variant" << std::setw( 8 ) << "type"
+            << std::setw( 8 ) << "threads" << std::setw( 10 ) << "schedule" << std::right
+            << std::setw( 11 ) << "median ms" << std::setw( 10 ) << "p95 ms" << std::setw( 9 ) << "GOP/s"
+            << std::setw( 9 ) << "GB/s" << "  ok     reference" << std::endl;
+    }
+}
+
+void print_record( const record& r, const config& cfg, bool first )
+{
+    if ( cfg.format == "csv" )
+    {
+        std::cout << r.size << ',' << r.name << ',' << r.type << ',' << r.threads << ',' << r.schedule << ','
+            << r.median_ms << ',' << r.p95_ms << ',' << r.gops << ',' << r.gbps << ',' << r.ok << ',' << r.reference << std::endl;
+    }
+    else if ( cfg.format == "json" )
+    {
+        std::cout << ( first ? "  " : ",\n  " ) << "{\"size\": " << r.size << ", \"variant\": \"" << r.name
+            << "\", \"type\": \"" << r.type << "\", \"threads\": " << r.threads << ", \"schedule\": \"" << r.schedule
+            << "\", \"median_ms\": " << r.median_ms << ", \"p95_ms\": " << r.p95_ms << ", \"gops\": " << r.gops
+            << ", \"gbps\": " << r.gbps << ", \"ok\": " << std::boolalpha << r.ok << std::noboolalpha
+            << ", \"reference\": \"" << r.reference << "\"}" << std::flush;
+    }
+    else
+    {
+        std::cout << std::left << std::setw( 6 ) << r.size << std::setw( 16 ) << r.name << std::setw( 8 ) << r.type
+            << std::setw( 8 ) << r.threads << std::setw( 10 ) << r.schedule << std::right << std::fixed << std::setprecision( 2 )
+            << std::setw( 11 ) << r.median_ms << std::setw( 10 ) << r.p95_ms << std::setw( 9 ) << r.gops
+            << std::setw( 9 ) << r.gbps << "  " << std::left << std::setw( 7 ) << std::boolalpha << r.ok << std::noboolalpha
+            << r.reference << std::right << std::defaultfloat << std::endl;
+    }
+}
 
-    auto res_0 = time_count( mult_matrix_no_threads, first_matrix, second_matrix );
-    auto res_1 = time_count( mult_matrix_IJK, first_matrix, second_matrix );
-    auto res_2 = time_count (mult_matrix_JIK, first_matrix, second_matrix );
+/// @brief Прогоняет все сочетания размер x вариант x потоки x schedule
+/// @return true, если все результаты совпали с эталоном
+bool run( const config& cfg )
+{
+    const auto variants = all_variants();
+    auto all_ok = true;
+    auto first = true;
+    print_header( cfg );
+    for ( auto size : cfg.sizes )
+    {
+        auto a = matrix_t{};
+        auto b = matrix_t{};
+        fill_matrix( a, size, size, cfg.seed, 0 );
+        fill_matrix( b, size, size, cfg.seed, 1 );
+        sparsify( a, cfg.density, cfg.seed, 2 );
+        sparsify( b, cfg.density, cfg.seed, 3 );
+        #ifdef DEBUG
+        print_matrix( a );
+        std::cout << "----------" << std::endl;
+        print_matrix( b );
+        std::cout << "----------" << std::endl;
+        #endif
+        const auto expected = make_reference( a, b );
+
+        for ( auto&& v : variants )
+        {
+            if ( size > v.max_size || ( v.name + '/' + v.type ).find( cfg.only ) == std::string::npos )
+            {
+                continue;
+            }
+            const auto prepared = v.prepare( a, b );
+            for ( auto threads : cfg.threads )
+            {
+                omp_set_num_threads( threads );
+                const auto schedules = v.scheduled ? cfg.schedules : std::vector< std::string >{ "-" };
+                for ( auto&& schedule : schedules )
+                {
+                    if ( v.scheduled )
+                    {
+                        set_schedule( schedule );
+                    }
+                    auto r = measure( v, prepared, size, threads, schedule, expected, cfg );
+                    all_ok = all_ok && r.ok;
+                    print_record( r, cfg, first );
+                    first = false;
+                }
+            }
+        }
+    }
+    if ( cfg.format == "json" )
+    {
+        std::cout << ( first ? "]" : "\n]" ) << std::endl;
+    }
+    return all_ok;
+}
+
+template < typename T >
+std::vector< T > parse_list( std::string_view list, T ( *parse )( const std::string& ) )
+{
+    auto ret = std::vector< T >{};
+    while ( !list.empty() )
+    {
+        auto comma = list.find( ',' );
+        ret.push_back( parse( std::string{ list.substr( 0, comma ) } ) );
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr( comma + 1 );
+    }
+    return ret;
+}
+
+std::size_t parse_size( const std::string& s ) { return std::stoul( s ); }
+int parse_int( const std::string& s ) { return std::stoi( s ); }
+std::string parse_string( const std::string& s ) { return s; }
+
+/// @brief --sizes=256,512 --threads=1,4 --schedules=static,dynamic
+/// --warmup=1 --reps=5 --density=0.05 --seed=7 --format=table|csv|json --only=micro
+config parse_args( int argc, char** argv )
+{
+    auto cfg = config{};
+    for ( int i = 1; i < argc; ++i )
+    {
+        auto arg = std::string_view{ argv[ i ] };
+        auto value = [ & ]( std::string_view key ) { return std::string{ arg.substr( key.size() ) }; };
+        if ( arg.starts_with( "--sizes=" ) )
+        {
+            cfg.sizes = parse_list( value( "--sizes=" ), parse_size );
+        }
+        else if ( arg.starts_with( "--threads=" ) )
+        {
+            cfg.threads = parse_list( value( "--threads=" ), parse_int );
+        }
+        else if ( arg.starts_with( "--schedules=" ) )
+        {
+            cfg.schedules = parse_list( value( "--schedules=" ), parse_string );
+        }
+        else if ( arg.starts_with( "--warmup=" ) )
+        {
+            cfg.warmup = std::stoul( value( "--warmup=" ) );
+        }
+        else if ( arg.starts_with( "--reps=" ) )
+        {
+            cfg.repetitions = std::max< std::size_t >( std::stoul( value( "--reps=" ) ), 1 );
+        }
+        else if ( arg.starts_with( "--format=" ) )
+        {
+            cfg.format = value( "--format=" );
+        }
+        else if ( arg.starts_with( "--density=" ) )
+        {
+            cfg.density = std::stod( value( "--density=" ) );
+        }
+        else if ( arg.starts_with( "--seed=" ) )
+        {
+            cfg.seed = std::stoull( value( "--seed=" ) );
+        }
+        else if ( arg.starts_with( "--only=" ) )
+        {
+            cfg.only = value( "--only=" );
+        }
+        else
+        {
+            throw std::invalid_argument( "Error: \"unknown argument " + std::string{ arg } + "\"" );
+        }
+    }
+    if ( !( cfg.density > 0 && cfg.density <= 1 ) )
+    {
+        throw std::invalid_argument( "Error: \"density must be in (0, 1]\"" );
+    }
+    if ( cfg.format != "table" && cfg.format != "csv" && cfg.format != "json" )
+    {
+        throw std::invalid_argument( "Error: \"unknown format " + cfg.format + "\"" );
+    }
+    for ( auto size : cfg.sizes )
+    {
+        if ( size == 0 || size > std::numeric_limits< uint16_t >::max() )
+        {
+            throw std::invalid_argument( "Error: \"size must be in [1, 65535]\"" );
+        }
+    }
+    for ( auto threads : cfg.threads )
+    {
+        if ( threads < 1 )
+        {
+            throw std::invalid_argument( "Error: \"thread count must be positive\"" );
+        }
+    }
+    for ( auto&& schedule : cfg.schedules )
+    {
+        set_schedule( schedule );
+    }
+    return cfg;
+}
 
-    std::cout << "Is eq?\t" << std::boolalpha << check_eq( res_0, res_1 ) << std::endl;
-    std::cout << "Is eq?\t" << std::boolalpha << check_eq( res_0, res_2 ) << std::endl;
-    #ifdef DEBUG
-    std::cout << "--" << std::endl;
-    #endif
+} // namespace bench
 
+} // namespace
 
+int main( int argc, char** argv ) try
+{
+    const auto cfg = bench::parse_args( argc, argv );
+    if ( cfg.format == "table" )
+    {
+        std::cout << "Running a program" << std::endl;
+    }
+    return bench::run( cfg ) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 catch(const std::exception& e)
 {
@@ -4,43 +4,161 @@
 #include <algorithm>
 #include <ctime>
 #include <random>
-#include <cassert>
 #include <mpi.h>
-#include <thread>
+#include <array>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.hpp"
+
+/// Битовая матрица: строка упакована в слова Word, столбец j - бит
+/// j % word_bits слова j / word_bits. Хвост последнего слова строки нулевой.
+template < typename Word >
+class bit_matrix
+{
+	static_assert( std::is_unsigned_v< Word > );
+
+public:
+	static constexpr std::size_t word_bits = sizeof( Word ) * 8;
+
+	bit_matrix() = default;
+
+	bit_matrix( std::size_t rows, std::size_t columns )
+		: rows_( rows )
+		, columns_( columns )
+		, words_( ( columns + word_bits - 1 ) / word_bits )
+		, data_( rows_ * words_ )
+	{
+	}
 
-constexpr auto bits_size = 8;
-using bitset_t = std::vector<int32_t>;
-using matrix_t = std::vector<bitset_t>;
-using indexes_t = std::array<int32_t, 2>;
+	std::size_t rows() const { return rows_; }
+	std::size_t columns() const { return columns_; }
+	std::size_t words_per_row() const { return words_; }
+
+	Word* data() { return data_.data(); }
+	const Word* data() const { return data_.data(); }
+	Word* row( std::size_t i ) { return data_.data() + i * words_; }
+	const Word* row( std::size_t i ) const { return data_.data() + i * words_; }
+
+	bool get( std::size_t i, std::size_t j ) const
+	{
+		return ( row( i )[ j / word_bits ] >> ( j % word_bits ) ) & 1;
+	}
+
+	void set( std::size_t i, std::size_t j, bool value )
+	{
+		auto& word = row( i )[ j / word_bits ];
+		const auto bit = static_cast< Word >( Word{ 1 } << ( j % word_bits ) );
+		word = static_cast< Word >( value ? word | bit : word & ~bit );
+	}
 
-int get_random_int()
+	/// @return Маска существующих столбцов в слове w строки
+	Word column_mask( std::size_t w ) const
+	{
+		const auto tail = columns_ - w * word_bits;
+		return tail >= word_bits ? static_cast< Word >( ~Word{} ) : static_cast< Word >( ( Word{ 1 } << tail ) - 1 );
+	}
+
+private:
+	std::size_t rows_ = 0;
+	std::size_t columns_ = 0;
+	std::size_t words_ = 0;
+	std::vector< Word > data_;
+};
+
+using word_t = uint64_t;
+using matrix_t = bit_matrix< word_t >;
+
+template < typename Word >
+MPI_Datatype mpi_word_type()
 {
-	std::random_device rd;
-	std::uniform_int_distribution<int32_t> dist(0, 500);
-	return dist( rd ) % 2 ? 1 : 0;
+	if constexpr ( sizeof( Word ) == 1 ) {
+		return MPI_UINT8_T;
+	} else if constexpr ( sizeof( Word ) == 2 ) {
+		return MPI_UINT16_T;
+	} else if constexpr ( sizeof( Word ) == 4 ) {
+		return MPI_UINT32_T;
+	} else {
+		return MPI_UINT64_T;
+	}
 }
 
-bool duplicateInSquare( const matrix_t& matrix, uint16_t i, uint16_t j )
+/// @brief Заполняет матрицу случайными битами
+/// Слова строки i зависят только от seed и i, так что матрицу можно
+/// воспроизвести и заполнять по частям
+/// @param first_row номер первой строки матрицы в полной матрице
+template < typename Word >
+void fill_random_bits( bit_matrix< Word >& matrix, uint64_t seed, std::size_t first_row = 0 )
 {
-	/*if ( !( matrix[i][j] ^ matrix[i + 1][j] ) &&
-		!( matrix[i][j] ^ matrix[i][j + 1] ) &&
-		!( matrix[i][j] ^ matrix[i + 1][j + 1] ) ) {
-		return true;
-	}*/
+	const auto words = matrix.words_per_row();
+	for ( std::size_t i = 0; i < matrix.rows(); ++i ) {
+		auto* row = matrix.row( i );
+		custom::fill_uniform< Word >( row, words, 0, static_cast< Word >( ~Word{} ), seed, uint64_t( first_row + i ) * words );
+		row[ words - 1 ] &= matrix.column_mask( words - 1 );
+	}
+}
 
-	if ( ( matrix[i][j] == matrix[i + 1][j] ) &&
-		( matrix[i][j] == matrix[i][j + 1] ) &&
-		( matrix[i][j] == matrix[i + 1][j + 1] ) ) {
-			return true;
+namespace detail
+{
+
+/// Слово из 0101...: единицы в чётных столбцах (размер слова чётный)
+template < typename Word >
+constexpr Word even_columns = static_cast< Word >( static_cast< Word >( ~Word{} ) / 3 );
+
+/// @return Слово w, сдвинутое на один столбец влево (бит j <- столбец j + 1)
+template < typename Word >
+Word next_columns( const Word* row, std::size_t w, std::size_t words )
+{
+	const auto high = w + 1 < words ? static_cast< Word >( row[ w + 1 ] << ( bit_matrix< Word >::word_bits - 1 ) ) : Word{};
+	return static_cast< Word >( ( row[ w ] >> 1 ) | high );
+}
+
+/// @brief Маска левых столбцов одноцветных квадратов 2x2 в слове w
+/// Бит j: top[ j ] == bottom[ j ] == top[ j + 1 ] == bottom[ j + 1 ]
+template < typename Word >
+Word duplicate_mask( const Word* top, const Word* bottom, std::size_t w, std::size_t words, Word valid )
+{
+	const auto top_next = next_columns( top, w, words );
+	const auto bottom_next = next_columns( bottom, w, words );
+	return static_cast< Word >( ~( top[ w ] ^ bottom[ w ] ) & ~( top[ w ] ^ top_next ) & ~( bottom[ w ] ^ bottom_next ) & valid );
+}
+
+/// @return Маска столбцов, у которых есть сосед справа: левые углы квадратов
+template < typename Word >
+Word square_mask( std::size_t columns, std::size_t w )
+{
+	if ( columns < 2 ) {
+		return Word{};
 	}
-	return false;
+	constexpr auto word_bits = bit_matrix< Word >::word_bits;
+	const auto last = columns - 1;
+	const auto tail = last - std::min( last, w * word_bits );
+	return tail >= word_bits ? static_cast< Word >( ~Word{} ) : static_cast< Word >( ( Word{ 1 } << tail ) - 1 );
+}
+
+} // namespace detail
+
+template < typename Word >
+bool duplicateInSquare( const bit_matrix< Word >& matrix, std::size_t i, std::size_t j )
+{
+	const auto value = matrix.get( i, j );
+	return matrix.get( i + 1, j ) == value && matrix.get( i, j + 1 ) == value && matrix.get( i + 1, j + 1 ) == value;
 }
 
-bool hasDuplicates( const matrix_t& matrix )
+/// @brief Есть ли одноцветный квадрат в строках [from, to] (по парам соседних)
+template < typename Word >
+bool hasDuplicates( const bit_matrix< Word >& matrix, std::size_t from, std::size_t to )
 {
-	for ( int i = 0; i < matrix.size() - 1; ++i ) {
-		for ( int j = 0; j < bits_size - 1; ++j ) {
-			if ( duplicateInSquare( matrix, i, j ) ) {
+	const auto words = matrix.words_per_row();
+	for ( auto i = from; i < to && i + 1 < matrix.rows(); ++i ) {
+		for ( std::size_t w = 0; w < words; ++w ) {
+			if ( detail::duplicate_mask( matrix.row( i ), matrix.row( i + 1 ), w, words, detail::square_mask< Word >( matrix.columns(), w ) ) ) {
 				return true;
 			}
 		}
@@ -48,186 +166,465 @@ bool hasDuplicates( const matrix_t& matrix )
 	return false;
 }
 
-void removeDuplicates( matrix_t& matrix, int32_t from, int32_t to, bool cout = false )
+template < typename Word >
+bool hasDuplicates( const bit_matrix< Word >& matrix )
 {
-	if (to == matrix.size() ) {
-		to = to - 1;
-	}
-	for ( int i = from; i < to; ++i ) {
-		for ( int j = 0; j < 8; ++j ) {
-			if ( duplicateInSquare( matrix, i, j ) ) {
-				matrix[i + 1][j + 1] ^= 1;
-			}
+	return hasDuplicates( matrix, 0, matrix.rows() );
+}
+
+/// @brief Есть ли квадрат между строкой halo и строкой row матрицы
+template < typename Word >
+bool hasDuplicatesBelow( const Word* halo, const bit_matrix< Word >& matrix, std::size_t row )
+{
+	const auto words = matrix.words_per_row();
+	for ( std::size_t w = 0; w < words; ++w ) {
+		if ( detail::duplicate_mask( halo, matrix.row( row ), w, words, detail::square_mask< Word >( matrix.columns(), w ) ) ) {
+			return true;
 		}
 	}
+	return false;
 }
 
-void removeDuplicatesInLast( matrix_t& matrix, int32_t from, int32_t to, bool cout = false )
+namespace detail
+{
+
+/// @brief Убирает одноцветные квадраты в паре строк upper, lower,
+/// переворачивая правый нижний бит квадрата
+/// Результат тот же, что у прохода слева направо: в серии подряд идущих
+/// квадратов, начатой в столбце s, переворачиваются квадраты s, s + 2, ...
+/// Серии выделяются переносом при сложении маски с её началами, поэтому
+/// вся строка обрабатывается за несколько операций на слово.
+/// @return Был ли перевёрнут хотя бы один бит
+template < typename Word >
+bool remove_in_pair( const Word* upper, Word* lower, std::size_t words, std::size_t columns, std::vector< Word >& scratch )
 {
-	if (to == matrix.size() ) {
-		to = to - 1;
+	constexpr auto word_bits = bit_matrix< Word >::word_bits;
+	constexpr auto even = even_columns< Word >;
+
+	scratch.resize( words );
+	Word any{};
+	for ( std::size_t w = 0; w < words; ++w ) {
+		scratch[ w ] = duplicate_mask( upper, lower, w, words, square_mask< Word >( columns, w ) );
+		any |= scratch[ w ];
 	}
-	for ( int i = from; i < to; ++i ) {
-		for ( int j = 0; j < 8; ++j ) {
-			if ( duplicateInSquare( matrix, i, j ) ) {
-				matrix[i][j + 1] ^= 1;
-			}
-		}
+	if ( !any ) {
+		return false;
 	}
+
+	Word shift_in{};
+	Word carry{};
+	Word flip_in{};
+	for ( std::size_t w = 0; w < words; ++w ) {
+		const auto d = scratch[ w ];
+		const auto starts = static_cast< Word >( d & ~static_cast< Word >( ( d << 1 ) | shift_in ) );
+		shift_in = static_cast< Word >( d >> ( word_bits - 1 ) );
+
+		const auto even_starts = static_cast< Word >( starts & even );
+		const auto partial = static_cast< Word >( d + even_starts );
+		const auto sum = static_cast< Word >( partial + carry );
+		carry = static_cast< Word >( ( partial < d ) | ( sum < partial ) );
+		const auto even_runs = static_cast< Word >( d & ~sum );
+
+		const auto flips = static_cast< Word >( ( even_runs & even ) | ( d & ~even_runs & ~even ) );
+		lower[ w ] ^= static_cast< Word >( ( flips << 1 ) | flip_in );
+		flip_in = static_cast< Word >( flips >> ( word_bits - 1 ) );
+	}
+	return true;
 }
 
-void removeDuplicatesInLast( matrix_t& matrix, int32_t row )
+} // namespace detail
+
+/// @brief Убирает одноцветные квадраты в строках top, top + 1
+/// @return Изменилась ли строка top + 1
+template < typename Word >
+bool removeDuplicatesInPair( bit_matrix< Word >& matrix, std::size_t top, std::vector< Word >& scratch )
 {
+	return detail::remove_in_pair( matrix.row( top ), matrix.row( top + 1 ), matrix.words_per_row(), matrix.columns(), scratch );
+}
 
-	for ( int j = 0; j < 8; ++j ) {
-			if (  j % 2  ) {
-				matrix[row][j] = 1;
-			} else {
-				matrix[row][j] = 0;
-			}
-	}
+/// @brief Убирает квадраты между строкой halo (соседней сверху, чужой)
+/// и строкой row матрицы
+/// @return Изменилась ли строка row
+template < typename Word >
+bool removeDuplicatesBelow( const Word* halo, bit_matrix< Word >& matrix, std::size_t row, std::vector< Word >& scratch )
+{
+	return detail::remove_in_pair( halo, matrix.row( row ), matrix.words_per_row(), matrix.columns(), scratch );
 }
 
-void print_matrix( matrix_t& matrix )
+template < typename Word >
+bool removeDuplicates( bit_matrix< Word >& matrix, std::size_t from, std::size_t to )
 {
-	std::for_each( matrix.begin(), matrix.end(), []( auto&& bits ) {
-		std::for_each( bits.begin(), bits.end(), [] ( auto&& bit ) {
-			std::cout << bit;
-		} );
-		std::cout << std::endl;
-	} );
+	if ( to >= matrix.rows() ) {
+		to = matrix.rows() - 1;
+	}
+	auto scratch = std::vector< Word >{};
+	auto changed = false;
+	for ( auto i = from; i < to; ++i ) {
+		changed |= removeDuplicatesInPair( matrix, i, scratch );
+	}
+	return changed;
 }
 
-void start( int argc, char* argv[] )
+/// @brief Доводит проход по строкам [from, to] после изменения строки from:
+/// строки ниже пары без переворотов не менялись с прошлого прохода и уже чисты
+template < typename Word >
+void propagateChange( bit_matrix< Word >& matrix, std::size_t from, std::size_t to, std::vector< Word >& scratch )
 {
-	MPI_Init(&argc, &argv);
-	constexpr auto rank_of_program = 0;
-	int rank{};
-	int comm_size{};
-	// Получаем номер конкретного процесса на котором запущена программа
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-	// Получаем количество запущенных процессов
-	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
-	assert ( comm_size >= 2 );
-	int32_t matrix_size = 18;
+	for ( auto i = from; i < to; ++i ) {
+		if ( !removeDuplicatesInPair( matrix, i, scratch ) ) {
+			break;
+		}
+	}
+}
 
-	if (rank == 0) {
+template < typename Word >
+void print_matrix( const bit_matrix< Word >& matrix )
+{
+	for ( std::size_t i = 0; i < matrix.rows(); ++i ) {
+		for ( std::size_t j = 0; j < matrix.columns(); ++j ) {
+			std::cout << matrix.get( i, j );
+		}
+		std::cout << std::endl;
+	}
+}
 
-		auto prepare_matrix = [&]
-		{
-			auto ret = std::vector<std::vector<int>>{};
-			std::cout << "Matrix size: " << matrix_size << std::endl;
-			ret.resize( matrix_size );
-			for ( int i = 0; i < matrix_size; ++i ) {
-				for ( int j = 0; j < bits_size; ++j ) {
-					ret[i].push_back( get_random_int() );
+/// @brief Убирает квадраты в куске строк slab, распределённом по процессам
+/// Квадрат на стыке кусков принадлежит нижнему процессу: он получает
+/// последнюю строку верхнего соседа (halo) и переворачивает биты только в
+/// своей первой строке. Кусок так же делится на полосы по потокам, и стык
+/// полос обрабатывается как стык кусков, только halo копируется в памяти.
+/// MPI вызывает только главный поток вне параллельных областей
+/// (MPI_THREAD_FUNNELED).
+/// @param up, down соседние процессы или MPI_PROC_NULL
+/// @return Число итераций обмена
+int removeDuplicatesDistributed( matrix_t& slab, int up, int down, int threads )
+{
+	const auto rows = slab.rows();
+	const auto words = slab.words_per_row();
+	const auto stripes = static_cast< std::size_t >( std::max( threads, 1 ) );
+	// Как и между процессами, пустыми могут быть только последние полосы
+	auto stripe_begin = [&] ( std::size_t t ) {
+		return t * ( rows / stripes ) + std::min( t, rows % stripes );
+	};
+	// halos[ t ] - строка над полосой t: для t = 0 приходит от процесса up
+	auto halos = std::vector< word_t >( stripes * words );
+	auto halo = [&] ( std::size_t t ) { return halos.data() + t * words; };
+	auto outgoing = std::vector< word_t >( words );
+	auto scratch = std::vector< std::vector< word_t > >( stripes );
+
+	// Итерация: последняя строка уходит вниз, пока внутренние строки
+	// обрабатываются; затем чинятся стыки с halo, и изменение доводится вниз
+	// по полосе. Отправленная строка могла устареть, поэтому повторяем, пока
+	// хоть кто-то что-то меняет: итерация без изменений значит, что все пары
+	// проверены на актуальных данных.
+	int iterations = 0;
+	for ( int changed = 1; changed; ++iterations ) {
+		MPI_Request requests[2];
+		if ( rows > 0 ) {
+			std::copy_n( slab.row( rows - 1 ), words, outgoing.begin() );
+		}
+		MPI_Irecv(halo( 0 ), static_cast<int>( words ), mpi_word_type<word_t>(), up, 0, MPI_COMM_WORLD, &requests[0]);
+		MPI_Isend(outgoing.data(), static_cast<int>( words ), mpi_word_type<word_t>(), down, 0, MPI_COMM_WORLD, &requests[1]);
+
+		int local = 0;
+		if ( iterations == 0 ) {
+			#pragma omp parallel for schedule( static, 1 ) num_threads( threads ) reduction( || : local )
+			for ( std::size_t t = 0; t < stripes; ++t ) {
+				const auto begin = stripe_begin( t );
+				const auto end = stripe_begin( t + 1 );
+				if ( end - begin > 1 && removeDuplicates( slab, begin, end - 1 ) ) {
+					local = 1;
 				}
 			}
+		}
+		for ( std::size_t t = 1; t < stripes && stripe_begin( t ) < rows; ++t ) {
+			std::copy_n( slab.row( stripe_begin( t ) - 1 ), words, halo( t ) );
+		}
 
-			return ret;
-		};
+		MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+		#pragma omp parallel for schedule( static, 1 ) num_threads( threads ) reduction( || : local )
+		for ( std::size_t t = 0; t < stripes; ++t ) {
+			const auto begin = stripe_begin( t );
+			const auto end = stripe_begin( t + 1 );
+			if ( begin == end || ( t == 0 && up == MPI_PROC_NULL ) ) {
+				continue;
+			}
+			if ( removeDuplicatesBelow( halo( t ), slab, begin, scratch[ t ] ) ) {
+				propagateChange( slab, begin, end - 1, scratch[ t ] );
+				local = 1;
+			}
+		}
 
-		/// 1 0 1 1 1
-		/// 1 1 0 0 0
-		/// 1 0 0 1 1
-		/// 1 1 0 1 1
-		/// 0 0 1 1 1
-		/// 0 0 0 0 0
+		changed = local;
+		MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+	}
+	return iterations;
+}
 
-		auto send_n_recv = [&] ( const indexes_t& indexes, matrix_t& matrix, int32_t dist )
-		{
-			MPI_Send(indexes.data(), indexes.size(), MPI_INT, dist, 0, MPI_COMM_WORLD);
+/// @brief Есть ли квадраты в матрице, распределённой кусками по процессам,
+/// включая стыки кусков
+bool hasDuplicatesDistributed( const matrix_t& slab, int up, int down )
+{
+	const auto words = static_cast<int>( slab.words_per_row() );
+	auto halo = std::vector< word_t >( words );
+	const auto* last = slab.rows() > 0 ? slab.row( slab.rows() - 1 ) : halo.data();
+	MPI_Sendrecv(last, words, mpi_word_type<word_t>(), down, 0,
+		halo.data(), words, mpi_word_type<word_t>(), up, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+	int found = hasDuplicates( slab ) || ( up != MPI_PROC_NULL && slab.rows() > 0 && hasDuplicatesBelow( halo.data(), slab, 0 ) );
+	MPI_Allreduce(MPI_IN_PLACE, &found, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+	return found;
+}
 
-			for ( int j = indexes[0], counter = 0; counter < indexes[1]; ++counter, ++j )
-			{
-				MPI_Send(matrix[j].data(), bits_size, MPI_INT, dist, 0, MPI_COMM_WORLD);
-			}
-			for ( int j = indexes[0], counter = 0; counter < indexes[1]; ++counter, ++j )
-			{
-				MPI_Recv(matrix[j].data(), bits_size, MPI_INT, dist, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
-		};
+/// Файл матрицы: заголовок, за ним rows строк по words_per_row слов word_t
+/// в порядке байт машины, хвост последнего слова строки нулевой
+struct matrix_file_header
+{
+	uint64_t rows;
+	uint64_t columns;
+};
 
-		auto matrix = prepare_matrix();
-		print_matrix( matrix );
+MPI_File openMatrixFile( const std::string& path, int mode )
+{
+	MPI_File file{};
+	if ( MPI_File_open(MPI_COMM_WORLD, path.c_str(), mode, MPI_INFO_NULL, &file) != MPI_SUCCESS ) {
+		throw std::runtime_error( "Error: \"cannot open " + path + "\"" );
+	}
+	return file;
+}
 
-		std::cout << ( !hasDuplicates( matrix )? "[WARN]: No duplications" : "[INFO]: There are duplications!" ) << std::endl;
-		// std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+/// @return Смещение строки row в файле матрицы
+MPI_Offset rowOffset( const matrix_t& slab, std::size_t row )
+{
+	return static_cast<MPI_Offset>( sizeof( matrix_file_header ) + row * slab.words_per_row() * sizeof( word_t ) );
+}
 
-		std::cout << "Matrix successfully generated" << std::endl;
-		std::cout << "Trying to send a matrix in pieces..." << std::endl;
-
-		auto indexes = indexes_t{ 0, 0 };
-		auto count_processors = comm_size - 1;
-		indexes[1] = matrix_size / count_processors;
-		send_n_recv( indexes, matrix, 1 );
-
-		if ( matrix_size / count_processors != matrix_size ) {
-			indexes[0] += ( indexes[1] );
-			// indexes[1] += 1;
-			for ( int i = 1; i < count_processors - 1 ; ++i )
-			{
-				send_n_recv( indexes, matrix, i + 1 );
-				indexes[0] += ( indexes[1] );
-			}
+matrix_file_header readMatrixHeader( const std::string& path )
+{
+	auto file = openMatrixFile( path, MPI_MODE_RDONLY );
+	auto header = matrix_file_header{};
+	MPI_File_read_at_all(file, 0, &header, sizeof( header ), MPI_BYTE, MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+	return header;
+}
 
-			indexes[1] = matrix_size / count_processors + matrix_size % count_processors;
-			//indexes[1] += 1;
-			send_n_recv( indexes, matrix, count_processors );
-		}
+/// @brief Каждый процесс читает из файла только свой кусок строк
+/// [first_row, first_row + slab.rows())
+void readSlab( const std::string& path, matrix_t& slab, std::size_t first_row, MPI_Datatype row_type )
+{
+	auto file = openMatrixFile( path, MPI_MODE_RDONLY );
+	MPI_Status status{};
+	MPI_File_read_at_all(file, rowOffset( slab, first_row ), slab.data(), static_cast<int>( slab.rows() ), row_type, &status);
+	MPI_File_close(&file);
+
+	int count{};
+	MPI_Get_count(&status, row_type, &count);
+	int truncated = count != static_cast<int>( slab.rows() );
+	MPI_Allreduce(MPI_IN_PLACE, &truncated, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+	if ( truncated ) {
+		throw std::runtime_error( "Error: \"" + path + " is shorter than its header says\"" );
+	}
+	const auto words = slab.words_per_row();
+	for ( std::size_t i = 0; i < slab.rows(); ++i ) {
+		slab.row( i )[ words - 1 ] &= slab.column_mask( words - 1 );
+	}
+}
 
-		std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
-		print_matrix( matrix );
-		std::cout << ( !hasDuplicates( matrix )? "[INFO]: no duplications, congrats!" : "[ERROR]: There are still duplications in your matrix" ) << std::endl;
-		std::cout << "Programm successfully finished" << std::endl;
+/// @brief Каждый процесс пишет свой кусок строк на его место в файле
+void writeSlab( const std::string& path, const matrix_t& slab, std::size_t first_row, std::size_t rows, MPI_Datatype row_type )
+{
+	auto file = openMatrixFile( path, MPI_MODE_CREATE | MPI_MODE_WRONLY );
+	MPI_File_set_size(file, rowOffset( slab, rows ));
+	int rank{};
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	if (rank == 0) {
+		const auto header = matrix_file_header{ rows, slab.columns() };
+		MPI_File_write_at(file, 0, &header, sizeof( header ), MPI_BYTE, MPI_STATUS_IGNORE);
+	}
+	MPI_File_write_at_all(file, rowOffset( slab, first_row ), slab.data(), static_cast<int>( slab.rows() ), row_type, MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+}
+
+/// @brief Вызывает MPI_Finalize при выходе из области видимости
+struct mpi_finalizer
+{
+	mpi_finalizer() = default;
+	mpi_finalizer( const mpi_finalizer& ) = delete;
+	mpi_finalizer& operator=( const mpi_finalizer& ) = delete;
+
+	~mpi_finalizer()
+	{
+		MPI_Finalize();
+	}
+};
+
+void start( int argc, char* argv[] )
+{
+	// 7 [seed] [rows] [columns] [threads] [--input FILE] [--output FILE]
+	// threads - список через запятую, для каждого значения решение
+	// повторяется и печатается его время. С --input матрица (и её размер)
+	// читается из файла, с --output результат пишется в файл; в обоих
+	// случаях каждый процесс держит в памяти только свой кусок строк.
+	auto positional = std::vector<std::string>{};
+	auto input = std::string{};
+	auto output = std::string{};
+	for ( int i = 1; i < argc; ++i ) {
+		const auto arg = std::string{ argv[i] };
+		if ( ( arg == "--input" || arg == "--output" ) && i + 1 < argc ) {
+			( arg == "--input" ? input : output ) = argv[++i];
+		} else {
+			positional.push_back( arg );
+		}
+	}
+	const uint64_t seed = positional.size() > 0 ? std::stoull( positional[0] ) : custom::philox4x32::default_seed;
+	int32_t matrix_size = positional.size() > 1 ? std::stoi( positional[1] ) : 18;
+	std::size_t columns = positional.size() > 2 ? std::stoul( positional[2] ) : 8;
+	auto thread_counts = std::vector<int>{};
+	if ( positional.size() > 3 ) {
+		const auto& list = positional[3];
+		for ( std::size_t begin = 0; begin <= list.size(); ) {
+			auto end = std::min( list.find( ',', begin ), list.size() );
+			thread_counts.push_back( std::stoi( list.substr( begin, end - begin ) ) );
+			begin = end + 1;
+		}
 	} else {
+#ifdef _OPENMP
+		thread_counts.push_back( omp_get_max_threads() );
+#else
+		thread_counts.push_back( 1 );
+#endif
+	}
+	if ( std::any_of( thread_counts.begin(), thread_counts.end(), [] ( int threads ) { return threads < 1; } ) ) {
+		throw std::invalid_argument( "Error: \"thread count must be positive\"" );
+	}
 
-		auto prepare_matrix = [&]
-		{
-			auto ret = std::vector<std::vector<int>> {};
-			ret.resize(matrix_size);
-			for ( int i = 0; i < matrix_size; ++i )
-			{
-				ret[i].resize( bits_size );
-			}
-			return ret;
-		};
-
-		auto recv_indexes = [&]
-		{
-			auto ret = indexes_t {};
-			MPI_Recv(ret.data(), ret.size(), MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			return ret;
-		};
-
-		auto recv_n_send = [] ( const indexes_t& indexes, matrix_t& matrix, const std::function<void( matrix_t& )>& callback )
-		{
-			for ( int i = indexes[0], counter = 0; counter < indexes[1]; ++counter, ++i )
-			{
-				MPI_Recv(matrix[i].data(), bits_size, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			}
+	// Потоки не вызывают MPI, достаточно FUNNELED
+	int provided{};
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	// MPI_Finalize вызывается при любом выходе, в том числе по исключению;
+	// все исключения после инициализации бросаются всеми процессами сразу
+	const auto finalize = mpi_finalizer{};
+	int rank{};
+	int comm_size{};
+	// Получаем номер конкретного процесса на котором запущена программа
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	// Получаем количество запущенных процессов
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	if ( provided < MPI_THREAD_FUNNELED ) {
+		if (rank == 0) {
+			std::cout << "[WARN]: MPI_THREAD_FUNNELED is not supported, running single-threaded" << std::endl;
+		}
+		thread_counts.assign( 1, 1 );
+	}
 
-			std::cout << "\n\n";
+	if ( !input.empty() ) {
+		const auto header = readMatrixHeader( input );
+		if ( header.rows > static_cast<uint64_t>( std::numeric_limits<int32_t>::max() ) ) {
+			throw std::invalid_argument( "Error: \"" + input + " has too many rows\"" );
+		}
+		matrix_size = static_cast<int32_t>( header.rows );
+		columns = header.columns;
+	}
+	if ( matrix_size < 2 || columns < 2 ) {
+		throw std::invalid_argument( "Error: \"matrix must have at least 2 rows and 2 columns\"" );
+	}
+	// Без файлов полная матрица собирается на нулевом процессе,
+	// иначе каждый процесс читает или порождает только свой кусок
+	const auto streaming = !input.empty() || !output.empty();
+
+	auto show = [&] ( const matrix_t& matrix ) {
+		if ( matrix.rows() <= 64 && matrix.columns() <= 128 ) {
 			print_matrix( matrix );
-			std::cout << "\n\n";
-			callback( matrix );
+		}
+	};
+
+	/// 1 0 1 1 1
+	/// 1 1 0 0 0
+	/// 1 0 0 1 1
+	/// 1 1 0 1 1
+	/// 0 0 1 1 1
+	/// 0 0 0 0 0
+
+	// Строки делятся поровну между всеми процессами, включая нулевой;
+	// первые matrix_size % comm_size процессов получают на строку больше
+	auto counts = std::vector<int>( comm_size );
+	auto displacements = std::vector<int>( comm_size );
+	for ( int i = 0, offset = 0; i < comm_size; ++i ) {
+		counts[i] = matrix_size / comm_size + ( i < matrix_size % comm_size ? 1 : 0 );
+		displacements[i] = offset;
+		offset += counts[i];
+	}
+	// Процессы без строк (их больше, чем строк) в обмене не участвуют
+	const auto active = std::min( comm_size, matrix_size );
+	const auto up = rank > 0 && rank < active ? rank - 1 : MPI_PROC_NULL;
+	const auto down = rank + 1 < active ? rank + 1 : MPI_PROC_NULL;
+
+	auto slab = matrix_t( counts[rank], columns );
+	// Строка матрицы - один элемент, так что счётчики считаются в строках
+	MPI_Datatype row_type{};
+	MPI_Type_contiguous(static_cast<int>( slab.words_per_row() ), mpi_word_type<word_t>(), &row_type);
+	MPI_Type_commit(&row_type);
+
+	auto source = matrix_t{};
+	auto matrix = matrix_t{};
+	if (rank == 0) {
+		std::cout << "Matrix size: " << matrix_size << "x" << columns;
+		if ( input.empty() ) {
+			std::cout << ", seed: " << seed;
+		} else {
+			std::cout << ", input: " << input;
+		}
+		std::cout << std::endl;
+	}
+	if (rank == 0 && !streaming) {
+		source = matrix_t( matrix_size, columns );
+		fill_random_bits( source, seed );
+		show( source );
 
-			for ( int i = indexes[0], counter = 0; counter < indexes[1]; ++counter, ++i )
-			{
-				MPI_Send(matrix[i].data(), bits_size, MPI_INT, 0, 0, MPI_COMM_WORLD);
-			}
-		};
+		std::cout << ( !hasDuplicates( source )? "[WARN]: No duplications" : "[INFO]: There are duplications!" ) << std::endl;
+		std::cout << "Matrix successfully generated" << std::endl;
+		matrix = matrix_t( matrix_size, columns );
+	}
 
-		auto matrix = prepare_matrix();
-		auto indexes = recv_indexes();
-		recv_n_send( indexes, matrix, [&] ( matrix_t& matrix ) {
-			removeDuplicates ( matrix, indexes[0], indexes[0] + indexes[1] - 1 );
-			// removeDuplicatesInLast ( matrix, indexes[0] + indexes[1] - 1, indexes[0] + indexes[1] );
-			removeDuplicatesInLast ( matrix, indexes[0] + indexes[1] - 1 );
-		} );
+	auto all_clean = true;
+	for ( const auto threads : thread_counts ) {
+		MPI_Barrier(MPI_COMM_WORLD);
+		const auto start_time = MPI_Wtime();
+
+		if ( !input.empty() ) {
+			readSlab( input, slab, displacements[rank], row_type );
+		} else if ( streaming ) {
+			fill_random_bits( slab, seed, displacements[rank] );
+		} else {
+			MPI_Scatterv(source.data(), counts.data(), displacements.data(), row_type,
+				slab.data(), counts[rank], row_type, 0, MPI_COMM_WORLD);
+		}
+		const auto iterations = removeDuplicatesDistributed( slab, up, down, threads );
+		if ( !output.empty() ) {
+			writeSlab( output, slab, displacements[rank], matrix_size, row_type );
+		} else if ( !streaming ) {
+			MPI_Gatherv(slab.data(), counts[rank], row_type,
+				matrix.data(), counts.data(), displacements.data(), row_type, 0, MPI_COMM_WORLD);
+		}
 
+		const auto elapsed = MPI_Wtime() - start_time;
+		const auto clean = !hasDuplicatesDistributed( slab, up, down );
+		all_clean = all_clean && clean;
+		if (rank == 0) {
+			std::cout << "ranks: " << comm_size << ", threads: " << threads
+				<< ", iterations: " << iterations << ", time: " << elapsed * 1000 << " ms"
+				<< ( clean ? "" : " [ERROR]" ) << std::endl;
+		}
+	}
+	MPI_Type_free(&row_type);
+
+	if (rank == 0) {
+		if ( !streaming ) {
+			show( matrix );
+		}
+		std::cout << ( all_clean ? "[INFO]: no duplications, congrats!" : "[ERROR]: There are still duplications in your matrix" ) << std::endl;
+		std::cout << "Programm successfully finished" << std::endl;
 	}
-	MPI_Finalize();
 }
 
 int main(int argc, char *argv[]) try {
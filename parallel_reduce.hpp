@@ -0,0 +1,249 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <ranges>
+#include <concepts>
+#include <exception>
+#include <mutex>
+#include <cstddef>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace custom
+{
+
+enum class reduce_backend
+{
+    /// Команда потоков OpenMP; без -fopenmp работает как threads
+    openmp,
+    /// Потоки std::thread, создаваемые на время вызова
+    threads,
+};
+
+struct reduce_options
+{
+    reduce_backend backend = reduce_backend::openmp;
+    /// Результат не зависит от числа потоков и порядка их работы:
+    /// результаты блоков складываются деревом в порядке блоков.
+    /// Иначе каждый поток копит свою частичную сумму по захваченным
+    /// блокам, и op должна быть коммутативной.
+    bool deterministic = false;
+    /// Элементов в блоке
+    std::size_t grain = std::size_t{ 1 } << 14;
+    /// 0 - по числу аппаратных потоков (для OpenMP - omp_get_max_threads)
+    std::size_t thread_count = 0;
+};
+
+namespace detail
+{
+
+inline constexpr std::size_t cache_line_size = 64;
+
+/// Частичная сумма потока на своей кэш-линии
+template < class T >
+struct alignas( cache_line_size ) padded
+{
+    T value;
+};
+
+inline std::size_t default_thread_count( reduce_backend backend )
+{
+#ifdef _OPENMP
+    if ( backend == reduce_backend::openmp )
+    {
+        return static_cast<std::size_t>( omp_get_max_threads() );
+    }
+#endif
+    return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+/// @brief Запускает body( worker ) для worker из [0, workers)
+/// Вызывающий поток работает как worker 0. Первое исключение из body
+/// пробрасывается после завершения всех потоков.
+template < class Body >
+void run_workers( reduce_backend backend, std::size_t workers, Body& body )
+{
+    auto error = std::exception_ptr{};
+    auto error_mutex = std::mutex{};
+    auto guarded = [ & ]( std::size_t worker )
+    {
+        try
+        {
+            body( worker );
+        }
+        catch ( ... )
+        {
+            std::lock_guard<std::mutex> lock( error_mutex );
+            if ( !error )
+            {
+                error = std::current_exception();
+            }
+        }
+    };
+
+#ifdef _OPENMP
+    if ( backend == reduce_backend::openmp )
+    {
+        #pragma omp parallel num_threads( static_cast<int>( workers ) )
+        guarded( static_cast<std::size_t>( omp_get_thread_num() ) );
+    }
+    else
+#endif
+    {
+        auto threads = std::vector<std::jthread>{};
+        threads.reserve( workers - 1 );
+        for ( std::size_t worker = 1; worker < workers; ++worker )
+        {
+            threads.emplace_back( guarded, worker );
+        }
+        guarded( 0 );
+    }
+    if ( error )
+    {
+        std::rethrow_exception( error );
+    }
+}
+
+template < class T, class Op >
+T tree_combine( std::vector<T>& values, std::size_t first, std::size_t last, Op& op )
+{
+    if ( last - first == 1 )
+    {
+        return std::move( values[ first ] );
+    }
+    const auto middle = first + ( last - first ) / 2;
+    auto left = tree_combine( values, first, middle, op );
+    return op( std::move( left ), tree_combine( values, middle, last, op ) );
+}
+
+} // namespace detail
+
+/// @brief Свёртка по блокам индексов [0, count)
+/// Потоки захватывают блоки по grain элементов через общий счётчик;
+/// block( begin, end ) возвращает результат блока, результаты блоков
+/// объединяются op. op должна быть ассоциативной, identity - её нейтральным
+/// элементом.
+template < class T, class Op, class Block >
+T reduce_blocks( std::size_t count, T identity, Op op, Block block, reduce_options options = {} )
+{
+    const auto grain = std::max<std::size_t>( options.grain, 1 );
+    const auto blocks = ( count + grain - 1 ) / grain;
+    if ( blocks == 0 )
+    {
+        return identity;
+    }
+    auto workers = options.thread_count ? options.thread_count : detail::default_thread_count( options.backend );
+    workers = std::clamp<std::size_t>( workers, 1, blocks );
+
+    auto next = std::atomic<std::size_t>{ 0 };
+    auto for_each_block = [ & ]( auto&& consume )
+    {
+        for ( auto b = next.fetch_add( 1, std::memory_order_relaxed ); b < blocks; b = next.fetch_add( 1, std::memory_order_relaxed ) )
+        {
+            consume( b, block( b * grain, std::min( count, ( b + 1 ) * grain ) ) );
+        }
+    };
+
+    if ( options.deterministic )
+    {
+        auto results = std::vector<T>( blocks, identity );
+        auto body = [ & ]( std::size_t )
+        {
+            for_each_block( [ & ]( std::size_t b, T&& value ) { results[ b ] = std::move( value ); } );
+        };
+        detail::run_workers( options.backend, workers, body );
+        return detail::tree_combine( results, 0, blocks, op );
+    }
+
+    auto partials = std::vector< detail::padded<T> >( workers, detail::padded<T>{ identity } );
+    auto body = [ & ]( std::size_t worker )
+    {
+        auto local = identity;
+        for_each_block( [ & ]( std::size_t, T&& value ) { local = op( std::move( local ), std::move( value ) ); } );
+        partials[ worker ].value = std::move( local );
+    };
+    detail::run_workers( options.backend, workers, body );
+    auto result = std::move( partials[ 0 ].value );
+    for ( std::size_t worker = 1; worker < workers; ++worker )
+    {
+        result = op( std::move( result ), std::move( partials[ worker ].value ) );
+    }
+    return result;
+}
+
+/// @brief Вызывает block( begin, end ) по блокам [0, count) в параллель
+template < class Block >
+void for_each_block( std::size_t count, Block block, reduce_options options = {} )
+{
+    struct none {};
+    reduce_blocks( count, none{}, []( none, none ) { return none{}; },
+        [ & ]( std::size_t begin, std::size_t end )
+        {
+            block( begin, end );
+            return none{};
+        }, options );
+}
+
+/// @brief op( ... op( identity, transform( x0 ) ) ..., transform( xn ) )
+/// в параллель по блокам
+template < std::random_access_iterator It, class T, class Op, class Transform >
+    requires std::invocable< Transform&, std::iter_reference_t<It> >
+T transform_reduce( It first, It last, T identity, Op op, Transform transform, reduce_options options = {} )
+{
+    return reduce_blocks( static_cast<std::size_t>( last - first ), identity, op,
+        [ & ]( std::size_t begin, std::size_t end )
+        {
+            auto acc = identity;
+            for ( auto it = first + begin, stop = first + end; it != stop; ++it )
+            {
+                acc = op( std::move( acc ), transform( *it ) );
+            }
+            return acc;
+        }, options );
+}
+
+/// @brief Свёртка transform( x[ i ], y[ i ] ) по двум последовательностям
+template < std::random_access_iterator It1, std::random_access_iterator It2, class T, class Op, class Transform >
+    requires std::invocable< Transform&, std::iter_reference_t<It1>, std::iter_reference_t<It2> >
+T transform_reduce( It1 first1, It1 last1, It2 first2, T identity, Op op, Transform transform, reduce_options options = {} )
+{
+    return reduce_blocks( static_cast<std::size_t>( last1 - first1 ), identity, op,
+        [ & ]( std::size_t begin, std::size_t end )
+        {
+            auto acc = identity;
+            for ( auto i = begin; i < end; ++i )
+            {
+                acc = op( std::move( acc ), transform( first1[ i ], first2[ i ] ) );
+            }
+            return acc;
+        }, options );
+}
+
+template < std::ranges::random_access_range Range, class T, class Op, class Transform >
+    requires std::ranges::common_range<Range>
+T transform_reduce( Range&& range, T identity, Op op, Transform transform, reduce_options options = {} )
+{
+    return transform_reduce( std::ranges::begin( range ), std::ranges::end( range ), identity, op, transform, options );
+}
+
+template < std::random_access_iterator It, class T, class Op >
+T parallel_reduce( It first, It last, T identity, Op op, reduce_options options = {} )
+{
+    return transform_reduce( first, last, identity, op, std::identity{}, options );
+}
+
+template < std::ranges::random_access_range Range, class T, class Op >
+    requires std::ranges::common_range<Range>
+T parallel_reduce( Range&& range, T identity, Op op, reduce_options options = {} )
+{
+    return parallel_reduce( std::ranges::begin( range ), std::ranges::end( range ), identity, op, options );
+}
+
+} // namespace custom
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+#include "parallel_reduce.hpp"
+
+namespace custom
+{
+
+/// @brief Счётчиковый генератор Philox4x32-10 (Salmon et al., Random123)
+/// Блок из четырёх 32-битных слов - биекция номера блока под ключом seed,
+/// поэтому i-е слово потока вычисляется без состояния: потоки независимы,
+/// переход вперёд стоит O(1), а заполнение массива по частям из разных
+/// потоков даёт тот же результат, что и последовательное.
+class philox4x32
+{
+public:
+    using result_type = uint32_t;
+    using block_t = std::array<uint32_t, 4>;
+
+    static constexpr uint64_t default_seed = 0x5eed;
+
+    /// @param seed ключ генератора
+    /// @param stream номер независимого потока слов при одном seed
+    explicit philox4x32( uint64_t seed = default_seed, uint64_t stream = 0 )
+        : seed_( seed )
+        , stream_( stream )
+    {
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()()
+    {
+        if ( word_ % 4 == 0 )
+        {
+            buffer_ = block( seed_, stream_, word_ / 4 );
+        }
+        return buffer_[ word_++ % 4 ];
+    }
+
+    /// @brief Переход вперёд на n слов
+    void discard( uint64_t n )
+    {
+        word_ += n;
+        if ( word_ % 4 != 0 )
+        {
+            buffer_ = block( seed_, stream_, word_ / 4 );
+        }
+    }
+
+    /// @return Блок index потока stream
+    static block_t block( uint64_t seed, uint64_t stream, uint64_t index )
+    {
+        block_t out;
+        blocks( seed, stream, index, 1, out.data() );
+        return out;
+    }
+
+    /// @brief Пишет в out слова блоков [first, first + count) подряд
+    /// Блоки считаются пачками в раскладке «структура массивов», так что
+    /// циклы раундов векторизуются; ширина SIMD выбирается по CPUID.
+    static void blocks( uint64_t seed, uint64_t stream, uint64_t first, std::size_t count, uint32_t* out )
+    {
+        static const auto kernel = select_kernel();
+        kernel( seed, stream, first, count, out );
+    }
+
+private:
+    using kernel_fn = void ( * )( uint64_t, uint64_t, uint64_t, std::size_t, uint32_t* );
+
+    [[gnu::always_inline]] static inline void blocks_body( uint64_t seed, uint64_t stream, uint64_t first,
+        std::size_t count, uint32_t* out )
+    {
+        constexpr std::size_t batch = 32;
+        for ( std::size_t base = 0; base < count; base += batch )
+        {
+            uint32_t c0[ batch ], c1[ batch ], c2[ batch ], c3[ batch ];
+            for ( std::size_t j = 0; j < batch; ++j )
+            {
+                const uint64_t index = first + base + j;
+                c0[ j ] = static_cast<uint32_t>( index );
+                c1[ j ] = static_cast<uint32_t>( index >> 32 );
+                c2[ j ] = static_cast<uint32_t>( stream );
+                c3[ j ] = static_cast<uint32_t>( stream >> 32 );
+            }
+            auto k0 = static_cast<uint32_t>( seed );
+            auto k1 = static_cast<uint32_t>( seed >> 32 );
+            for ( int round = 0; round < 10; ++round )
+            {
+                for ( std::size_t j = 0; j < batch; ++j )
+                {
+                    const uint64_t p0 = uint64_t{ multiplier_0 } * c0[ j ];
+                    const uint64_t p1 = uint64_t{ multiplier_1 } * c2[ j ];
+                    const auto x0 = static_cast<uint32_t>( p1 >> 32 ) ^ c1[ j ] ^ k0;
+                    const auto x2 = static_cast<uint32_t>( p0 >> 32 ) ^ c3[ j ] ^ k1;
+                    c1[ j ] = static_cast<uint32_t>( p1 );
+                    c3[ j ] = static_cast<uint32_t>( p0 );
+                    c0[ j ] = x0;
+                    c2[ j ] = x2;
+                }
+                k0 += weyl_0;
+                k1 += weyl_1;
+            }
+            const auto m = std::min( batch, count - base );
+            for ( std::size_t j = 0; j < m; ++j )
+            {
+                out[ 4 * ( base + j ) + 0 ] = c0[ j ];
+                out[ 4 * ( base + j ) + 1 ] = c1[ j ];
+                out[ 4 * ( base + j ) + 2 ] = c2[ j ];
+                out[ 4 * ( base + j ) + 3 ] = c3[ j ];
+            }
+        }
+    }
+
+    static void blocks_generic( uint64_t seed, uint64_t stream, uint64_t first, std::size_t count, uint32_t* out )
+    {
+        blocks_body( seed, stream, first, count, out );
+    }
+
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+    [[gnu::target( "avx2" )]]
+    static void blocks_avx2( uint64_t seed, uint64_t stream, uint64_t first, std::size_t count, uint32_t* out )
+    {
+        blocks_body( seed, stream, first, count, out );
+    }
+
+    [[gnu::target( "avx512f,avx512vl" )]]
+    static void blocks_avx512( uint64_t seed, uint64_t stream, uint64_t first, std::size_t count, uint32_t* out )
+    {
+        blocks_body( seed, stream, first, count, out );
+    }
+#endif
+
+    static kernel_fn select_kernel()
+    {
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512vl" ) )
+        {
+            return blocks_avx512;
+        }
+        if ( __builtin_cpu_supports( "avx2" ) )
+        {
+            return blocks_avx2;
+        }
+#endif
+        return blocks_generic;
+    }
+
+private:
+    static constexpr uint32_t multiplier_0 = 0xD2511F53;
+    static constexpr uint32_t multiplier_1 = 0xCD9E8D57;
+    static constexpr uint32_t weyl_0 = 0x9E3779B9;
+    static constexpr uint32_t weyl_1 = 0xBB67AE85;
+
+private:
+    uint64_t seed_;
+    uint64_t stream_;
+    uint64_t word_ = 0;
+    block_t buffer_{};
+};
+
+namespace detail
+{
+
+/// 64-битным типам нужно два слова на значение, остальным - одно
+template < class T >
+inline constexpr std::size_t words_per_value = sizeof( T ) > 4 ? 2 : 1;
+
+/// @brief Слово(а) генератора -> значение из [lo, hi] для целых и
+/// [lo, hi) для вещественных
+/// Целые - умножением со сдвигом (Lemire) без отбрасывания: смещение
+/// не больше span / 2^32, для диапазонов наших входов пренебрежимо.
+template < class T >
+T map_uniform( const uint32_t* words, T lo, T hi )
+{
+    if constexpr ( std::is_floating_point_v<T> )
+    {
+        if constexpr ( words_per_value<T> == 2 )
+        {
+            const auto bits = ( uint64_t{ words[ 1 ] } << 32 | words[ 0 ] ) >> 11;
+            return lo + ( hi - lo ) * static_cast<T>( static_cast<double>( bits ) * 0x1p-53 );
+        }
+        else
+        {
+            return lo + ( hi - lo ) * static_cast<T>( static_cast<float>( words[ 0 ] >> 8 ) * 0x1p-24f );
+        }
+    }
+    else
+    {
+        using unsigned_t = std::make_unsigned_t<T>;
+        if constexpr ( words_per_value<T> == 2 )
+        {
+            const auto word = uint64_t{ words[ 1 ] } << 32 | words[ 0 ];
+            const auto span = static_cast<uint64_t>( static_cast<unsigned_t>( hi ) - static_cast<unsigned_t>( lo ) ) + 1;
+            const auto offset = span == 0 ? word : static_cast<uint64_t>( ( static_cast<unsigned __int128>( word ) * span ) >> 64 );
+            return static_cast<T>( static_cast<unsigned_t>( lo ) + offset );
+        }
+        else
+        {
+            const auto span = uint64_t{ static_cast<unsigned_t>( static_cast<unsigned_t>( hi ) - static_cast<unsigned_t>( lo ) ) } + 1;
+            const auto offset = ( uint64_t{ words[ 0 ] } * span ) >> 32;
+            return static_cast<T>( static_cast<unsigned_t>( lo ) + offset );
+        }
+    }
+}
+
+} // namespace detail
+
+/// @brief out[ i ] - равномерное значение номер offset + i потока stream
+/// Результат зависит только от seed, stream и номера значения, поэтому
+/// куски одного массива можно заполнять независимо.
+template < class T >
+void fill_uniform( T* out, std::size_t n, T lo, T hi, uint64_t seed, uint64_t offset = 0, uint64_t stream = 0 )
+{
+    static_assert( std::is_arithmetic_v<T> && !std::is_same_v<T, bool> );
+    constexpr auto per_value = detail::words_per_value<T>;
+    constexpr std::size_t batch_blocks = 64;
+    uint32_t words[ 4 * batch_blocks ];
+
+    auto word = offset * per_value;
+    while ( n > 0 )
+    {
+        const auto first_block = word / 4;
+        const auto skip = word % 4;
+        const auto blocks = std::min<uint64_t>( batch_blocks, ( skip + n * per_value + 3 ) / 4 );
+        philox4x32::blocks( seed, stream, first_block, blocks, words );
+
+        const auto values = std::min<std::size_t>( n, ( blocks * 4 - skip ) / per_value );
+        const uint32_t* source = words + skip;
+        for ( std::size_t i = 0; i < values; ++i )
+        {
+            out[ i ] = detail::map_uniform<T>( source + i * per_value, lo, hi );
+        }
+        out += values;
+        n -= values;
+        word += values * per_value;
+    }
+}
+
+/// @brief fill_uniform, разрезанный на блоки по потокам
+template < class T >
+void parallel_fill_uniform( T* out, std::size_t n, T lo, T hi, uint64_t seed, uint64_t stream = 0,
+    reduce_options options = {} )
+{
+    for_each_block( n, [ & ]( std::size_t begin, std::size_t end )
+    {
+        fill_uniform( out + begin, end - begin, lo, hi, seed, begin, stream );
+    }, options );
+}
+
+} // namespace custom
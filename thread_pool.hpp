@@ -0,0 +1,420 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <future>
+#include <random>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <chrono>
+#include <exception>
+
+namespace custom
+{
+
+class thread_joiner
+{
+public:
+    /// @brief Конструктор
+    /// @param thread захватываемый поток
+    explicit thread_joiner( std::thread&& thread )
+        : thread_( std::move( thread ) )
+    {
+    }
+
+    /// @brief Деструктор
+    /// Вызов join
+    ~thread_joiner()
+    {
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    /// @return Захваченный поток
+    std::thread& get() { return thread_; }
+
+private:
+    std::thread thread_;
+};
+
+namespace detail
+{
+
+/// @brief Задача пула со стёртым типом
+struct task_base
+{
+    virtual ~task_base() = default;
+    virtual void run() = 0;
+};
+
+template < class F >
+struct task_impl final : task_base
+{
+    explicit task_impl( F&& fn ) : fn_( std::move( fn ) ) {}
+    void run() override { fn_(); }
+
+    F fn_;
+};
+
+/// @brief Дек Чейза-Ли: владелец кладёт и забирает с нижнего конца,
+/// остальные потоки крадут с верхнего
+class chase_lev_deque
+{
+    struct ring
+    {
+        explicit ring( std::int64_t capacity )
+            : capacity_( capacity )
+            , slots_( std::make_unique<std::atomic<task_base*>[]>( capacity ) )
+        {
+        }
+
+        task_base* get( std::int64_t i ) const
+        {
+            return slots_[ i & ( capacity_ - 1 ) ].load( std::memory_order_relaxed );
+        }
+
+        void put( std::int64_t i, task_base* task )
+        {
+            slots_[ i & ( capacity_ - 1 ) ].store( task, std::memory_order_relaxed );
+        }
+
+        const std::int64_t capacity_;
+        std::unique_ptr<std::atomic<task_base*>[]> slots_;
+    };
+
+public:
+    explicit chase_lev_deque( std::int64_t capacity = 256 )
+    {
+        rings_.push_back( std::make_unique<ring>( capacity ) );
+        ring_.store( rings_.back().get(), std::memory_order_relaxed );
+    }
+
+    chase_lev_deque( const chase_lev_deque& ) = delete;
+    chase_lev_deque& operator=( const chase_lev_deque& ) = delete;
+
+    /// @brief Вызывается только потоком-владельцем
+    void push( task_base* task )
+    {
+        auto b = bottom_.load( std::memory_order_relaxed );
+        auto t = top_.load( std::memory_order_acquire );
+        auto* r = ring_.load( std::memory_order_relaxed );
+        if ( b - t > r->capacity_ - 1 )
+        {
+            r = grow( r, t, b );
+        }
+        r->put( b, task );
+        std::atomic_thread_fence( std::memory_order_release );
+        bottom_.store( b + 1, std::memory_order_relaxed );
+    }
+
+    /// @brief Вызывается только потоком-владельцем
+    task_base* pop()
+    {
+        auto b = bottom_.load( std::memory_order_relaxed ) - 1;
+        auto* r = ring_.load( std::memory_order_relaxed );
+        bottom_.store( b, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        auto t = top_.load( std::memory_order_relaxed );
+        if ( t > b )
+        {
+            bottom_.store( b + 1, std::memory_order_relaxed );
+            return nullptr;
+        }
+        auto* task = r->get( b );
+        if ( t == b )
+        {
+            if ( !top_.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+            {
+                task = nullptr;
+            }
+            bottom_.store( b + 1, std::memory_order_relaxed );
+        }
+        return task;
+    }
+
+    /// @brief Может вызываться любым потоком
+    task_base* steal()
+    {
+        auto t = top_.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        auto b = bottom_.load( std::memory_order_acquire );
+        if ( t >= b )
+        {
+            return nullptr;
+        }
+        auto* task = ring_.load( std::memory_order_acquire )->get( t );
+        if ( !top_.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+        {
+            return nullptr;
+        }
+        return task;
+    }
+
+private:
+    /// Старые буферы живут до разрушения дека: их ещё могут читать воры
+    ring* grow( ring* old, std::int64_t top, std::int64_t bottom )
+    {
+        auto next = std::make_unique<ring>( old->capacity_ * 2 );
+        for ( auto i = top; i < bottom; ++i )
+        {
+            next->put( i, old->get( i ) );
+        }
+        rings_.push_back( std::move( next ) );
+        ring_.store( rings_.back().get(), std::memory_order_release );
+        return rings_.back().get();
+    }
+
+private:
+    alignas( 64 ) std::atomic<std::int64_t> top_{ 0 };
+    alignas( 64 ) std::atomic<std::int64_t> bottom_{ 0 };
+    std::atomic<ring*> ring_{ nullptr };
+    std::vector<std::unique_ptr<ring>> rings_;
+};
+
+} // namespace detail
+
+/// @brief Постоянный пул потоков с захватом работы (work stealing)
+/// У каждого рабочего потока свой дек Чейза-Ли; задачи извне попадают
+/// в общую очередь, простаивающие потоки крадут у случайной жертвы.
+class thread_pool
+{
+public: // special functions
+    /// @brief Конструктор
+    /// @param thread_count количество рабочих потоков
+    explicit thread_pool( std::size_t thread_count = std::max( 1u, std::thread::hardware_concurrency() ) )
+    {
+        thread_count = std::max<std::size_t>( thread_count, 1 );
+        for ( std::size_t i = 0; i < thread_count; ++i )
+        {
+            deques_.push_back( std::make_unique<detail::chase_lev_deque>() );
+        }
+        for ( std::size_t i = 0; i < thread_count; ++i )
+        {
+            workers_.push_back( std::make_unique<thread_joiner>( std::thread{ [ this, i ] { worker_loop( i ); } } ) );
+        }
+    }
+
+    /// @brief Деструктор
+    /// Дожидается выполнения всех поставленных задач
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            stop_ = true;
+        }
+        cv_.notify_all();
+        workers_.clear();
+    }
+
+    thread_pool( const thread_pool& ) = delete;
+    thread_pool( thread_pool&& ) = delete;
+    thread_pool& operator=( const thread_pool& ) = delete;
+    thread_pool& operator=( thread_pool&& ) = delete;
+
+public:
+    std::size_t size() const { return workers_.size(); }
+
+    /// @brief Ставит задачу в пул
+    /// @return future с результатом fn
+    template < class F >
+    auto submit( F&& fn ) -> std::future< std::invoke_result_t< std::decay_t<F> > >
+    {
+        using result_t = std::invoke_result_t< std::decay_t<F> >;
+        auto task = std::packaged_task<result_t()>{ std::forward<F>( fn ) };
+        auto future = task.get_future();
+        enqueue( new detail::task_impl<decltype( task )>( std::move( task ) ) );
+        return future;
+    }
+
+    /// @brief Выполняет body( begin, end ) над [first, last) кусками по grain
+    /// Вызывающий поток участвует в работе, поэтому вложенные вызовы
+    /// из задач пула не приводят к взаимоблокировке.
+    template < class Index, class F >
+    void parallel_for( Index first, Index last, Index grain, F&& body )
+    {
+        if ( !( first < last ) )
+        {
+            return;
+        }
+        grain = std::max<Index>( grain, 1 );
+        auto chunks = std::vector< std::future<void> >{};
+        auto begin = first;
+        for ( ; last - begin > grain; begin += grain )
+        {
+            chunks.push_back( submit( [ &body, begin, grain ] { body( begin, begin + grain ); } ) );
+        }
+        auto error = std::exception_ptr{};
+        try
+        {
+            body( begin, last );
+        }
+        catch ( ... )
+        {
+            error = std::current_exception();
+        }
+        for ( auto& chunk : chunks )
+        {
+            wait( chunk );
+        }
+        if ( error )
+        {
+            std::rethrow_exception( error );
+        }
+        for ( auto& chunk : chunks )
+        {
+            chunk.get();
+        }
+    }
+
+    /// @brief Ожидает future, выполняя задачи пула вместо блокировки
+    template < class R >
+    void wait( std::future<R>& future )
+    {
+        while ( future.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+        {
+            if ( auto* task = take( current_index() ) )
+            {
+                execute( task );
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static constexpr std::size_t no_worker = static_cast<std::size_t>( -1 );
+
+    /// @return Индекс рабочего потока этого пула или no_worker
+    std::size_t current_index() const
+    {
+        return current_pool_ == this ? current_worker_ : no_worker;
+    }
+
+    void enqueue( detail::task_base* task )
+    {
+        auto index = current_index();
+        if ( index != no_worker )
+        {
+            deques_[ index ]->push( task );
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock( injection_mutex_ );
+            injection_.push_back( task );
+        }
+        pending_.fetch_add( 1, std::memory_order_seq_cst );
+        if ( sleeping_.load( std::memory_order_seq_cst ) > 0 )
+        {
+            {
+                std::lock_guard<std::mutex> lock( mutex_ );
+            }
+            cv_.notify_one();
+        }
+    }
+
+    detail::task_base* take( std::size_t index )
+    {
+        detail::task_base* task = nullptr;
+        if ( index != no_worker )
+        {
+            task = deques_[ index ]->pop();
+        }
+        if ( !task )
+        {
+            std::lock_guard<std::mutex> lock( injection_mutex_ );
+            if ( !injection_.empty() )
+            {
+                task = injection_.front();
+                injection_.pop_front();
+            }
+        }
+        if ( !task )
+        {
+            task = steal( index );
+        }
+        if ( task )
+        {
+            pending_.fetch_sub( 1, std::memory_order_relaxed );
+        }
+        return task;
+    }
+
+    detail::task_base* steal( std::size_t thief )
+    {
+        thread_local auto rng = std::minstd_rand{ std::random_device{}() };
+        auto count = deques_.size();
+        auto start = rng() % count;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            auto victim = ( start + i ) % count;
+            if ( victim == thief )
+            {
+                continue;
+            }
+            if ( auto* task = deques_[ victim ]->steal() )
+            {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    static void execute( detail::task_base* task )
+    {
+        auto owned = std::unique_ptr<detail::task_base>( task );
+        owned->run();
+    }
+
+    void worker_loop( std::size_t index )
+    {
+        current_pool_ = this;
+        current_worker_ = index;
+        for ( ;; )
+        {
+            if ( auto* task = take( index ) )
+            {
+                execute( task );
+                continue;
+            }
+            std::unique_lock<std::mutex> lock( mutex_ );
+            sleeping_.fetch_add( 1, std::memory_order_seq_cst );
+            cv_.wait( lock, [ this ] { return stop_ || pending_.load( std::memory_order_seq_cst ) > 0; } );
+            sleeping_.fetch_sub( 1, std::memory_order_relaxed );
+            if ( stop_ && pending_.load( std::memory_order_seq_cst ) == 0 )
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    static inline thread_local const thread_pool* current_pool_ = nullptr;
+    static inline thread_local std::size_t current_worker_ = no_worker;
+
+private: // queues
+    std::vector<std::unique_ptr<detail::chase_lev_deque>> deques_;
+    std::mutex injection_mutex_;
+    std::deque<detail::task_base*> injection_;
+
+private: // sync
+    std::atomic<std::int64_t> pending_{ 0 };
+    std::atomic<std::int32_t> sleeping_{ 0 };
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+private:
+    std::vector<std::unique_ptr<thread_joiner>> workers_;
+};
+
+} // namespace custom